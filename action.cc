@@ -41,6 +41,8 @@ ModelAction::ModelAction(action_type_t type, memory_order order, void *loc,
 	last_fence_release(NULL),
 	node(NULL),
 	seq_number(ACTION_INITIAL_CLOCK),
+	loc_id(0),
+	site(NULL),
 	cv(NULL),
 	sleep_flag(false)
 {
@@ -69,6 +71,8 @@ ModelAction::~ModelAction()
 void ModelAction::copy_from_new(ModelAction *newaction)
 {
 	seq_number = newaction->seq_number;
+	loc_id = newaction->loc_id;
+	site = newaction->site;
 }
 
 void ModelAction::set_seq_number(modelclock_t num)
@@ -92,10 +92,14 @@ public:
 	void print() const;
 
 	thread_id_t get_tid() const { return tid; }
+	/** @brief Reassign this action's thread, e.g., when rebuilt from a
+	 * checkpoint */
+	void set_tid(thread_id_t id) { tid = id; }
 	action_type get_type() const { return type; }
 	memory_order get_mo() const { return order; }
 	void * get_location() const { return location; }
 	modelclock_t get_seq_number() const { return seq_number; }
+	unsigned int get_loc_id() const { return loc_id; }
 	uint64_t get_value() const { return value; }
 	uint64_t get_reads_from_value() const;
 	uint64_t get_write_value() const;
@@ -118,6 +122,9 @@ public:
 
 	void copy_from_new(ModelAction *newaction);
 	void set_seq_number(modelclock_t num);
+	void set_loc_id(unsigned int id) { loc_id = id; }
+	const void * get_site() const { return site; }
+	void set_site(const void *pc) { site = pc; }
 	void set_try_lock(bool obtainedlock);
 	bool is_thread_start() const;
 	bool is_thread_join() const;
@@ -233,6 +240,23 @@ private:
 	 */
 	modelclock_t seq_number;
 
+	/**
+	 * @brief The dense ID of this action's location
+	 *
+	 * Assigned by ModelExecution on the location's first touch in each
+	 * execution; see ModelExecution::get_loc_id()
+	 */
+	unsigned int loc_id;
+
+	/**
+	 * @brief The user program's call site for this action
+	 *
+	 * Only recorded for atomic loads and RMWs, where it tells a spin loop's
+	 * repeated reads apart from distinct reads of the same location (see
+	 * ModelExecution::update_spin_state()); otherwise NULL
+	 */
+	const void *site;
+
 	/**
 	 * @brief The clock vector for this operation
 	 *
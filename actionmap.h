@@ -0,0 +1,74 @@
+/** @file actionmap.h
+ *  @brief A flat table keyed by ModelAction.
+ */
+
+#ifndef __ACTIONMAP_H__
+#define __ACTIONMAP_H__
+
+#include "action.h"
+#include "common.h"
+#include "stl-model.h"
+
+/**
+ * @brief A table mapping ModelActions to values, stored as flat arrays
+ *
+ * Sequence numbers are dense within an execution, so actions index directly
+ * into an array instead of being hashed. ATOMIC_UNINIT actions all have
+ * sequence number 0, but there is one per location, so they are indexed by
+ * location ID instead.
+ *
+ * @tparam _Val Type name for the values to be stored; 0 means "no entry"
+ */
+template<typename _Val>
+class ActionMap {
+ public:
+	/**
+	 * @brief Lookup the value for a given action
+	 * @param act The action
+	 * @return The value in the table, if any; otherwise 0
+	 */
+	_Val get(const ModelAction *act) const {
+		const SnapVector<_Val> &vec = act->is_uninitialized() ? uninit : actions;
+		unsigned int index = get_index(act);
+		return index < vec.size() ? vec[index] : (_Val)0;
+	}
+
+	/** @return True, if the table holds a (non-zero) value for act */
+	bool contains(const ModelAction *act) const {
+		return get(act) != (_Val)0;
+	}
+
+	/**
+	 * @brief Put an action/value pair into the table
+	 * @param act The action; must have a sequence number (or location ID,
+	 * for ATOMIC_UNINIT)
+	 * @param val The value to store
+	 */
+	void put(const ModelAction *act, _Val val) {
+		SnapVector<_Val> &vec = act->is_uninitialized() ? uninit : actions;
+		unsigned int index = get_index(act);
+		ASSERT(index);
+		if (index >= vec.size())
+			vec.resize(index + 1);
+		vec[index] = val;
+	}
+
+	/** @brief Remove all entries */
+	void reset() {
+		actions.clear();
+		uninit.clear();
+	}
+
+	SNAPSHOTALLOC
+ private:
+	static unsigned int get_index(const ModelAction *act) {
+		return act->is_uninitialized() ? act->get_loc_id() : act->get_seq_number();
+	}
+
+	/** @brief Values for ordinary actions, indexed by sequence number */
+	SnapVector<_Val> actions;
+	/** @brief Values for ATOMIC_UNINIT actions, indexed by location ID */
+	SnapVector<_Val> uninit;
+};
+
+#endif /* __ACTIONMAP_H__ */
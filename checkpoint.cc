@@ -0,0 +1,102 @@
+#include <unistd.h>
+#include <errno.h>
+
+#include "checkpoint.h"
+
+/**
+ * @brief Start writing or reading a checkpoint file
+ * @param fd The open file. A Checkpoint is used for either writing or reading
+ * it, not both.
+ */
+Checkpoint::Checkpoint(int fd) :
+	fd(fd),
+	error(false),
+	pos(0),
+	len(0)
+{
+}
+
+void Checkpoint::put_byte(uint8_t byte)
+{
+	if (pos == BUFFER_SIZE && !flush())
+		return;
+	buf[pos++] = byte;
+}
+
+uint8_t Checkpoint::get_byte()
+{
+	if (pos == len) {
+		if (error)
+			return 0;
+		ssize_t ret;
+		do {
+			ret = read(fd, buf, BUFFER_SIZE);
+		} while (ret < 0 && errno == EINTR);
+		if (ret <= 0) {
+			/* Truncated (or unreadable) file */
+			error = true;
+			return 0;
+		}
+		pos = 0;
+		len = ret;
+	}
+	return buf[pos++];
+}
+
+/**
+ * @brief Write out the buffered bytes
+ * @return True if everything written so far made it to the file
+ */
+bool Checkpoint::flush()
+{
+	unsigned int done = 0;
+	while (!error && done < pos) {
+		ssize_t ret = write(fd, buf + done, pos - done);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			error = true;
+		else
+			done += ret;
+	}
+	pos = 0;
+	return !error;
+}
+
+/** @brief Write an unsigned integer, 7 bits at a time */
+void Checkpoint::put(uint64_t val)
+{
+	while (val >= 0x80) {
+		put_byte((val & 0x7f) | 0x80);
+		val >>= 7;
+	}
+	put_byte(val);
+}
+
+/** @brief Write a signed integer, zigzag-encoded so small negatives stay
+ * short */
+void Checkpoint::put_signed(int64_t val)
+{
+	put(((uint64_t)val << 1) ^ (uint64_t)(val >> 63));
+}
+
+/** @brief Read an unsigned integer written by put() */
+uint64_t Checkpoint::get()
+{
+	uint64_t val = 0;
+	for (unsigned int shift = 0; shift < 64; shift += 7) {
+		uint8_t byte = get_byte();
+		val |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return val;
+	}
+	error = true;
+	return 0;
+}
+
+/** @brief Read a signed integer written by put_signed() */
+int64_t Checkpoint::get_signed()
+{
+	uint64_t val = get();
+	return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+}
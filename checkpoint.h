@@ -0,0 +1,92 @@
+/** @file checkpoint.h
+ *  @brief Checkpoint files, for suspending and resuming an exploration.
+ */
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <stdint.h>
+
+#include "mymemory.h"
+#include "threadset.h"
+
+/** @brief The first bytes of a checkpoint ("MCCKPT" and a format version) */
+#define CHECKPOINT_MAGIC 0x313054504b43434dULL
+/** @brief The first bytes of a recorded choice sequence ("MCCHOI" and a
+ * format version) */
+#define CHOICES_MAGIC 0x3130494f4843434dULL
+
+/**
+ * @brief A checkpoint file being written or read
+ *
+ * Checkpoints hold the NodeStack's exploration frontier in a compact binary
+ * form: integers are stored as variable-length (LEB128) quantities, and
+ * references between ModelActions as indices into the NodeStack. They are
+ * only meaningful to the same program, run with the same parameters.
+ *
+ * The file is accessed through its descriptor and a buffer of our own, since
+ * stdio would allocate from the user program's heap.
+ *
+ * Errors are sticky: once a read or write fails, the rest are skipped, and
+ * failed() reports it.
+ */
+class Checkpoint {
+public:
+	Checkpoint(int fd);
+
+	void put(uint64_t val);
+	void put_signed(int64_t val);
+	template<void * (* _malloc)(size_t), void (*_free)(void *)>
+	void put_set(const ThreadSet<_malloc, _free> &set);
+
+	uint64_t get();
+	int64_t get_signed();
+	template<void * (* _malloc)(size_t), void (*_free)(void *)>
+	void get_set(ThreadSet<_malloc, _free> *set);
+
+	bool flush();
+
+	/** @brief Mark the checkpoint as bad (e.g., inconsistent) */
+	void fail() { error = true; }
+	bool failed() const { return error; }
+
+	MEMALLOC
+private:
+	void put_byte(uint8_t byte);
+	uint8_t get_byte();
+
+	static const unsigned int BUFFER_SIZE = 4096;
+
+	int fd;
+	bool error;
+	/** @brief The position in buf of the next byte to read or write */
+	unsigned int pos;
+	/** @brief The number of bytes read into buf */
+	unsigned int len;
+	uint8_t buf[BUFFER_SIZE];
+};
+
+/** @brief Write the members of a set */
+template<void * (* _malloc)(size_t), void (*_free)(void *)>
+void Checkpoint::put_set(const ThreadSet<_malloc, _free> &set)
+{
+	put(set.get_num_words());
+	for (unsigned int w = 0; w < set.get_num_words(); w++)
+		put(set.get_word(w));
+}
+
+/** @brief Read the members of a set, adding them to the given set */
+template<void * (* _malloc)(size_t), void (*_free)(void *)>
+void Checkpoint::get_set(ThreadSet<_malloc, _free> *set)
+{
+	unsigned int numwords = get();
+	for (unsigned int w = 0; w < numwords && !failed(); w++) {
+		uint64_t word = get();
+		while (word) {
+			set->add((w << 6) + __builtin_ctzll(word));
+			word &= word - 1;
+		}
+	}
+}
+
+#endif /* __CHECKPOINT_H__ */
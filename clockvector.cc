@@ -6,10 +6,181 @@
 #include "common.h"
 #include "threads-model.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CV_HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define CV_HAVE_X86_KERNELS 0
+#endif
+
+/**
+ * @brief Merge kernel: element-wise maximum of src into dst
+ * @param dst The clocks to merge into (aligned to CV_ALIGN)
+ * @param src The clocks to merge from (aligned to CV_ALIGN)
+ * @param len The number of clocks to process; a multiple of CV_PAD
+ * @return True if any element of dst changed
+ */
+typedef bool (*cv_merge_kernel_t)(modelclock_t *dst, const modelclock_t *src, int len);
+
+/**
+ * @brief Dominance kernel
+ * @return True if a[i] >= b[i] for all 0 <= i < len (len a multiple of CV_PAD)
+ */
+typedef bool (*cv_dominates_kernel_t)(const modelclock_t *a, const modelclock_t *b, int len);
+
+static bool merge_scalar(modelclock_t *dst, const modelclock_t *src, int len)
+{
+	bool changed = false;
+	for (int i = 0; i < len; i++)
+		if (src[i] > dst[i]) {
+			dst[i] = src[i];
+			changed = true;
+		}
+	return changed;
+}
+
+static bool dominates_scalar(const modelclock_t *a, const modelclock_t *b, int len)
+{
+	modelclock_t below = 0;
+	for (int i = 0; i < len; i++)
+		below |= (a[i] < b[i]);
+	return !below;
+}
+
+#if CV_HAVE_X86_KERNELS
+/*
+ * The vector kernels only store a chunk back when it actually changed, so that
+ * merging an already-dominated vector does not dirty (and fault in) a
+ * snapshotted page.
+ */
+
+__attribute__((target("sse4.1")))
+static bool merge_sse41(modelclock_t *dst, const modelclock_t *src, int len)
+{
+	__m128i changed = _mm_setzero_si128();
+	for (int i = 0; i < len; i += 4) {
+		__m128i d = _mm_load_si128((const __m128i *)&dst[i]);
+		__m128i s = _mm_load_si128((const __m128i *)&src[i]);
+		__m128i m = _mm_max_epu32(d, s);
+		__m128i diff = _mm_xor_si128(m, d);
+		if (!_mm_testz_si128(diff, diff)) {
+			_mm_store_si128((__m128i *)&dst[i], m);
+			changed = _mm_or_si128(changed, diff);
+		}
+	}
+	return !_mm_testz_si128(changed, changed);
+}
+
+__attribute__((target("sse4.1")))
+static bool dominates_sse41(const modelclock_t *a, const modelclock_t *b, int len)
+{
+	__m128i diff = _mm_setzero_si128();
+	for (int i = 0; i < len; i += 4) {
+		__m128i va = _mm_load_si128((const __m128i *)&a[i]);
+		__m128i vb = _mm_load_si128((const __m128i *)&b[i]);
+		diff = _mm_or_si128(diff, _mm_xor_si128(_mm_max_epu32(va, vb), va));
+	}
+	return _mm_testz_si128(diff, diff);
+}
+
+__attribute__((target("avx2")))
+static bool merge_avx2(modelclock_t *dst, const modelclock_t *src, int len)
+{
+	__m256i changed = _mm256_setzero_si256();
+	for (int i = 0; i < len; i += 8) {
+		__m256i d = _mm256_load_si256((const __m256i *)&dst[i]);
+		__m256i s = _mm256_load_si256((const __m256i *)&src[i]);
+		__m256i m = _mm256_max_epu32(d, s);
+		__m256i diff = _mm256_xor_si256(m, d);
+		if (!_mm256_testz_si256(diff, diff)) {
+			_mm256_store_si256((__m256i *)&dst[i], m);
+			changed = _mm256_or_si256(changed, diff);
+		}
+	}
+	return !_mm256_testz_si256(changed, changed);
+}
+
+__attribute__((target("avx2")))
+static bool dominates_avx2(const modelclock_t *a, const modelclock_t *b, int len)
+{
+	__m256i diff = _mm256_setzero_si256();
+	for (int i = 0; i < len; i += 8) {
+		__m256i va = _mm256_load_si256((const __m256i *)&a[i]);
+		__m256i vb = _mm256_load_si256((const __m256i *)&b[i]);
+		diff = _mm256_or_si256(diff, _mm256_xor_si256(_mm256_max_epu32(va, vb), va));
+	}
+	return _mm256_testz_si256(diff, diff);
+}
+#endif /* CV_HAVE_X86_KERNELS */
+
+static cv_merge_kernel_t merge_kernel = merge_scalar;
+static cv_dominates_kernel_t dominates_kernel = dominates_scalar;
+
+/** @brief Pick the widest kernels supported by the host CPU, at load time */
+__attribute__((constructor))
+static void select_kernels()
+{
+#if CV_HAVE_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		merge_kernel = merge_avx2;
+		dominates_kernel = dominates_avx2;
+	} else if (__builtin_cpu_supports("sse4.1")) {
+		merge_kernel = merge_sse41;
+		dominates_kernel = dominates_sse41;
+	}
+#endif
+}
+
+/** @return The padded array length needed to hold count clocks */
+static inline int padded_length(int count)
+{
+	return (count + CV_PAD - 1) & ~(CV_PAD - 1);
+}
+
+static inline modelclock_t * storage_clock(struct cv_storage *s)
+{
+	return (modelclock_t *)((char *)s + CV_ALIGN);
+}
+
+/**
+ * @brief Allocate clock storage, copying the first count clocks from src
+ *
+ * The rest of the clock array (including the padding) is zeroed.
+ * @param capacity The array length; a multiple of CV_PAD
+ * @param clock The clocks to copy, if any
+ * @param count The number of clocks to copy
+ * @return The new storage, with a single reference
+ */
+static struct cv_storage * storage_alloc(int capacity, const modelclock_t *clock, int count)
+{
+	size_t size = CV_ALIGN + capacity * sizeof(modelclock_t);
+	struct cv_storage *s = (struct cv_storage *)mspace_memalign(model_snapshot_space, CV_ALIGN, size);
+	ASSERT(s);
+	s->refs = 1;
+	s->capacity = capacity;
+
+	modelclock_t *newclock = storage_clock(s);
+	if (count)
+		std::memcpy(newclock, clock, count * sizeof(modelclock_t));
+	std::memset(&newclock[count], 0, (capacity - count) * sizeof(modelclock_t));
+	return s;
+}
+
+/** @brief Drop a reference to clock storage, freeing it with the last one */
+static void storage_release(struct cv_storage *s)
+{
+	if (--s->refs == 0)
+		snapshot_free(s);
+}
+
 /**
  * Constructs a new ClockVector, given a parent ClockVector and a first
  * ModelAction. This constructor can assign appropriate default settings if no
  * parent and/or action is supplied.
+ *
+ * If the parent belongs to the same thread, its storage is shared rather than
+ * copied.
  * @param parent is the previous ClockVector to inherit (i.e., clock from the
  * same thread or the parent that created this thread)
  * @param act is an action with which to update the ClockVector
@@ -17,47 +188,121 @@
 ClockVector::ClockVector(ClockVector *parent, ModelAction *act)
 {
 	ASSERT(act);
-	num_threads = int_to_id(act->get_tid()) + 1;
+	owner = id_to_int(act->get_tid());
+	own = act->get_seq_number();
+	num_threads = owner + 1;
 	if (parent && parent->num_threads > num_threads)
 		num_threads = parent->num_threads;
 
-	clock = (modelclock_t *)snapshot_calloc(num_threads, sizeof(int));
-	if (parent)
-		std::memcpy(clock, parent->clock, parent->num_threads * sizeof(modelclock_t));
+	if (parent && parent->owner == owner) {
+		parent->storage->refs++;
+		set_storage(parent->storage);
+		return;
+	}
 
-	clock[id_to_int(act->get_tid())] = act->get_seq_number();
+	if (!parent) {
+		set_storage(storage_alloc(padded_length(num_threads), NULL, 0));
+		clock[owner] = own;
+		return;
+	}
+
+	set_storage(storage_alloc(padded_length(num_threads), parent->clock, parent->num_threads));
+	clock[parent->owner] = parent->own;
+	clock[owner] = own;
 }
 
 /** @brief Destructor */
 ClockVector::~ClockVector()
 {
-	snapshot_free(clock);
+	storage_release(storage);
+}
+
+/** @brief Point this vector at the given storage */
+void ClockVector::set_storage(struct cv_storage *s)
+{
+	storage = s;
+	clock = storage_clock(s);
+}
+
+/**
+ * @brief Make sure this vector's storage is unshared and holds count clocks
+ *
+ * Copies the storage if it is shared or too small. Afterward, the array's
+ * entry for the owning thread is up to date.
+ * @param count The number of clocks needed
+ */
+void ClockVector::make_private(int count)
+{
+	int capacity = storage->capacity;
+	if (storage->refs > 1 || padded_length(count) > capacity) {
+		if (padded_length(count) > capacity)
+			capacity = padded_length(count);
+		struct cv_storage *s = storage_alloc(capacity, clock, num_threads);
+		storage_release(storage);
+		set_storage(s);
+	}
+	clock[owner] = own;
 }
 
 /**
  * Merge a clock vector into this vector, using a pairwise comparison. The
  * resulting vector length will be the maximum length of the two being merged.
+ *
  * @param cv is the ClockVector being merged into this vector.
+ * @return True if this vector changed
  */
 bool ClockVector::merge(const ClockVector *cv)
 {
 	ASSERT(cv != NULL);
-	bool changed = false;
-	if (cv->num_threads > num_threads) {
-		clock = (modelclock_t *)snapshot_realloc(clock, cv->num_threads * sizeof(modelclock_t));
-		for (int i = num_threads; i < cv->num_threads; i++)
-			clock[i] = 0;
+	/* Don't unshare our storage for nothing */
+	if (dominates(cv))
+		return false;
+
+	make_private(cv->num_threads);
+	if (cv->num_threads > num_threads)
 		num_threads = cv->num_threads;
+
+	/* Element-wise maximum; the zeroed padding never changes. cv's entry
+	 * for its own thread is stale (but never too large), so fix it up. */
+	merge_kernel(clock, cv->clock, padded_length(cv->num_threads));
+	if (cv->own > clock[cv->owner])
+		clock[cv->owner] = cv->own;
+	own = clock[owner];
+	return true;
+}
+
+/**
+ * @brief Check whether this vector dominates another
+ * @param cv The ClockVector to compare against
+ * @return True if every clock in this vector is at least the corresponding
+ * clock in cv (i.e., merging cv into this vector would not change it)
+ */
+bool ClockVector::dominates(const ClockVector *cv) const
+{
+	/* Vectors sharing storage differ only in their owner's clock */
+	if (storage == cv->storage)
+		return own >= cv->own;
+
+	/* The arrays' entries for the two owners may be stale */
+	if (own < cv->getClock(int_to_id(owner)) ||
+			getClock(int_to_id(cv->owner)) < cv->own)
+		return false;
+
+	int len = cv->num_threads;
+	if (len > num_threads) {
+		for (int i = num_threads; i < len; i++)
+			if (i != cv->owner && cv->clock[i] != 0)
+				return false;
+		len = num_threads;
 	}
+	if (dominates_kernel(clock, cv->clock, padded_length(len)))
+		return true;
 
-	/* Element-wise maximum */
-	for (int i = 0; i < cv->num_threads; i++)
-		if (cv->clock[i] > clock[i]) {
-			clock[i] = cv->clock[i];
-			changed = true;
-		}
-	
-	return changed;
+	/* The kernel may have only tripped over a stale owner entry */
+	for (int i = 0; i < len; i++)
+		if (i != owner && i != cv->owner && clock[i] < cv->clock[i])
+			return false;
+	return true;
 }
 
 /**
@@ -77,15 +322,18 @@ bool ClockVector::synchronized_since(const ModelAction *act) const
 	int i = id_to_int(act->get_tid());
 
 	if (i < num_threads)
-		return act->get_seq_number() <= clock[i];
+		return act->get_seq_number() <= getClock(act->get_tid());
 	return false;
 }
 
 /** Gets the clock corresponding to a given thread id from the clock vector. */
-modelclock_t ClockVector::getClock(thread_id_t thread) {
+modelclock_t ClockVector::getClock(thread_id_t thread) const
+{
 	int threadid = id_to_int(thread);
 
-	if (threadid < num_threads)
+	if (threadid == owner)
+		return own;
+	else if (threadid < num_threads)
 		return clock[threadid];
 	else
 		return 0;
@@ -97,5 +345,5 @@ void ClockVector::print() const
 	int i;
 	model_print("(");
 	for (i = 0; i < num_threads; i++)
-		model_print("%2u%s", clock[i], (i == num_threads - 1) ? ")\n" : ", ");
+		model_print("%2u%s", getClock(int_to_id(i)), (i == num_threads - 1) ? ")\n" : ", ");
 }
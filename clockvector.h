@@ -11,23 +11,68 @@
 /* Forward declaration */
 class ModelAction;
 
+/**
+ * @brief Number of clocks the clock array is padded to
+ *
+ * The clock array is always allocated in multiples of this many entries (one
+ * 256-bit vector), aligned to CV_ALIGN, with the padding kept zeroed. This
+ * lets the merge/compare kernels run over whole vectors without a tail loop.
+ */
+#define CV_PAD 8
+#define CV_ALIGN (CV_PAD * sizeof(modelclock_t))
+
+/**
+ * @brief Reference-counted clock storage, shared copy-on-write
+ *
+ * The header is followed (at offset CV_ALIGN) by the clock array. All
+ * ClockVectors sharing a storage belong to the same thread.
+ */
+struct cv_storage {
+	int refs;
+	int capacity; /**< @brief Length of the arrays; a multiple of CV_PAD */
+};
+
+/**
+ * @brief A clock vector
+ *
+ * Consecutive actions in a thread only differ in their own clock until one of
+ * them synchronizes, so a ClockVector keeps its owning thread's clock inline
+ * and shares the rest with the ClockVector it was created from, copying only
+ * when it is merged into. The array's entry for the owning thread is
+ * therefore stale: it holds the clock of whichever vector last had the
+ * storage to itself, which is never more than own. Only getClock() gives the
+ * owning thread's clock.
+ */
 class ClockVector {
 public:
 	ClockVector(ClockVector *parent = NULL, ModelAction *act = NULL);
 	~ClockVector();
 	bool merge(const ClockVector *cv);
+	bool dominates(const ClockVector *cv) const;
 	bool synchronized_since(const ModelAction *act) const;
 
 	void print() const;
-	modelclock_t getClock(thread_id_t thread);
+	modelclock_t getClock(thread_id_t thread) const;
 
 	SNAPSHOTALLOC
 private:
-	/** @brief Holds the actual clock data, as an array. */
+	void make_private(int count);
+	void set_storage(struct cv_storage *s);
+
+	/** @brief The (possibly shared) storage for clock */
+	struct cv_storage *storage;
+
+	/** @brief Holds the actual clock data, as a padded, aligned array. */
 	modelclock_t *clock;
 
 	/** @brief The number of threads recorded in clock (i.e., its length).  */
 	int num_threads;
+
+	/** @brief The thread this vector belongs to */
+	int owner;
+
+	/** @brief The owning thread's clock */
+	modelclock_t own;
 };
 
 #endif /* __CLOCKVECTOR_H__ */
@@ -2,34 +2,111 @@
 #include "action.h"
 #include "cmodelint.h"
 #include "threads-model.h"
+#include "datarace.h"
+
+/*
+ * Once an atomic action has been taken, its accesses are checked (with the
+ * thread's updated clock vector) against non-atomic accesses to the same
+ * object by the race detector.
+ */
+
+/** Performs a read action, made at the given call site */
+static inline uint64_t read_action(void *obj, memory_order ord, size_t size, const void *site) {
+	ModelAction *act = new ModelAction(ATOMIC_READ, ord, obj);
+	act->set_site(site);
+	uint64_t val = model->switch_to_master(act);
+	raceCheckAtomicRead(thread_current()->get_id(), obj, size, site);
+	return val;
+}
+
+/** Performs a write action, made at the given call site */
+static inline void write_action(void *obj, memory_order ord, uint64_t val, size_t size, const void *site) {
+	model->switch_to_master(new ModelAction(ATOMIC_WRITE, ord, obj, val));
+	raceCheckAtomicWrite(thread_current()->get_id(), obj, size, site);
+}
+
+/**
+ * Performs an init action, made at the given call site. Initialization is not
+ * an atomic access, so it races with any concurrent access to the object.
+ */
+static inline void init_action(void *obj, uint64_t val, size_t size, const void *site) {
+	model->switch_to_master(new ModelAction(ATOMIC_INIT, memory_order_relaxed, obj, val));
+	raceCheckWrite(thread_current()->get_id(), obj, size, site);
+}
+
+/**
+ * Performs the read part of a RMW action, made at the given call site. The
+ * next action must either be the write part of the RMW action or an explicit
+ * close out of the RMW action w/o a write.
+ */
+static inline uint64_t rmwr_action(void *obj, memory_order ord, size_t size, const void *site) {
+	ModelAction *act = new ModelAction(ATOMIC_RMWR, ord, obj);
+	act->set_site(site);
+	uint64_t val = model->switch_to_master(act);
+	raceCheckAtomicRead(thread_current()->get_id(), obj, size, site);
+	return val;
+}
+
+/** Performs the write part of a RMW action, made at the given call site */
+static inline void rmw_action(void *obj, memory_order ord, uint64_t val, size_t size, const void *site) {
+	model->switch_to_master(new ModelAction(ATOMIC_RMW, ord, obj, val));
+	raceCheckAtomicWrite(thread_current()->get_id(), obj, size, site);
+}
+
+/*
+ * The entry points without a size (kept for programs built against them) do
+ * not know the size of the atomic object, so only its first byte is checked
+ * by the race detector.
+ */
 
 /** Performs a read action.*/
 uint64_t model_read_action(void * obj, memory_order ord) {
-	return model->switch_to_master(new ModelAction(ATOMIC_READ, ord, obj));
+	return read_action(obj, ord, 1, __builtin_return_address(0));
+}
+
+/** Performs a read action on an object of size bytes.*/
+uint64_t model_read_action_sized(void * obj, memory_order ord, size_t size) {
+	return read_action(obj, ord, size, __builtin_return_address(0));
 }
 
 /** Performs a write action.*/
 void model_write_action(void * obj, memory_order ord, uint64_t val) {
-	model->switch_to_master(new ModelAction(ATOMIC_WRITE, ord, obj, val));
+	write_action(obj, ord, val, 1, __builtin_return_address(0));
+}
+
+/** Performs a write action on an object of size bytes.*/
+void model_write_action_sized(void * obj, memory_order ord, uint64_t val, size_t size) {
+	write_action(obj, ord, val, size, __builtin_return_address(0));
 }
 
 /** Performs an init action. */
 void model_init_action(void * obj, uint64_t val) {
-	model->switch_to_master(new ModelAction(ATOMIC_INIT, memory_order_relaxed, obj, val));
+	init_action(obj, val, 1, __builtin_return_address(0));
 }
 
-/**
- * Performs the read part of a RMW action. The next action must either be the
- * write part of the RMW action or an explicit close out of the RMW action w/o
- * a write.
- */
+/** Performs an init action on an object of size bytes. */
+void model_init_action_sized(void * obj, uint64_t val, size_t size) {
+	init_action(obj, val, size, __builtin_return_address(0));
+}
+
+/** Performs the read part of a RMW action. */
 uint64_t model_rmwr_action(void *obj, memory_order ord) {
-	return model->switch_to_master(new ModelAction(ATOMIC_RMWR, ord, obj));
+	return rmwr_action(obj, ord, 1, __builtin_return_address(0));
+}
+
+/** Performs the read part of a RMW action on an object of size bytes. */
+uint64_t model_rmwr_action_sized(void *obj, memory_order ord, size_t size) {
+	return rmwr_action(obj, ord, size, __builtin_return_address(0));
 }
 
 /** Performs the write part of a RMW action. */
 void model_rmw_action(void *obj, memory_order ord, uint64_t val) {
-	model->switch_to_master(new ModelAction(ATOMIC_RMW, ord, obj, val));
+	rmw_action(obj, ord, val, 1, __builtin_return_address(0));
+}
+
+/** Performs the write part of a RMW action on an object of size bytes. */
+void model_rmw_action_sized(void *obj, memory_order ord, uint64_t val, size_t size) {
+	rmw_action(obj, ord, val, size, __builtin_return_address(0));
 }
 
 /** Closes out a RMW action without doing a write. */
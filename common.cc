@@ -99,6 +99,7 @@ void redirect_output()
 		exit(EXIT_FAILURE);
 	}
 	close(pipefd[1]);
+	{ static char lbuf[8192]; setvbuf(stdout, lbuf, _IOFBF, sizeof(lbuf)); static char ebuf[8192]; setvbuf(stderr, ebuf, _IONBF, 0); }
 
 	/* Save the "read" side of the pipe for use later */
 	if (fcntl(pipefd[0], F_SETFL, O_NONBLOCK) < 0) {
@@ -45,11 +45,42 @@
 
 /** Thread parameters */
 
+/**
+ * If USE_FAST_CONTEXT=1, user threads and the model checker switch with a
+ * hand-written, register-only context switch (x86-64 and AArch64) rather
+ * than swapcontext(), which also saves and restores the signal mask with a
+ * system call on every switch.
+ */
+#ifndef USE_FAST_CONTEXT
+#if !defined(MAC) && (defined(__x86_64__) || defined(__aarch64__))
+#define USE_FAST_CONTEXT 1
+#else
+#define USE_FAST_CONTEXT 0
+#endif
+#endif
+
 /* Size of stack to allocate for a thread. */
 #define STACK_SIZE (1024 * 1024)
 
-/** How many shadow tables of memory to preallocate for data race detector. */
-#define SHADOWBASETABLES 4
+/**
+ * Number of thread stacks kept in the stack pool: the thread with each id
+ * (below this) reuses the same guarded, lazily committed stack in every
+ * execution. Threads with higher ids get a stack from the snapshotting heap.
+ */
+#define STACK_POOL_SLOTS 1024
+
+/** Size of each chunk of memory the NodeStack allocates its Nodes from */
+#define NODE_ARENA_CHUNK_SIZE (1 << 20)
+
+/**
+ * The data race detector's shadow memory is reserved in regions, each
+ * shadowing (1 << SHADOWREGIONBITS) bytes of the program's address space.
+ */
+#if BIT48
+#define SHADOWREGIONBITS 32
+#else
+#define SHADOWREGIONBITS 24
+#endif
 
 /** Enable debugging assertions (via ASSERT()) */
 #define CONFIG_ASSERT
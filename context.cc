@@ -1,3 +1,6 @@
+#include <stdint.h>
+#include <string.h>
+
 #include "context.h"
 
 #ifdef MAC
@@ -25,3 +28,206 @@ int model_swapcontext(ucontext_t *oucp, ucontext_t *ucp)
 }
 
 #endif /* MAC */
+
+#if USE_FAST_CONTEXT
+
+extern "C" {
+/** Saves the callee-saved registers on the stack, stores the stack pointer
+ * in *oldsp, and resumes the context suspended at newsp */
+void model_context_switch(void **oldsp, void *newsp) __attribute__((visibility("hidden")));
+/** Entry point of a new context: calls its function, then switches to its
+ * link context */
+void model_context_start() __attribute__((visibility("hidden")));
+void model_context_exit(model_context_t *link) __attribute__((visibility("hidden"), used));
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Saved frame, from the stack pointer up: MXCSR and the x87 control word
+ * (8 bytes), r15, r14, r13, r12, rbx, rbp, return address. A new context's
+ * frame holds its function in r12 and its link in r13.
+ */
+asm(
+"	.text\n"
+"	.globl model_context_switch\n"
+"	.type model_context_switch, @function\n"
+"model_context_switch:\n"
+"	pushq %rbp\n"
+"	pushq %rbx\n"
+"	pushq %r12\n"
+"	pushq %r13\n"
+"	pushq %r14\n"
+"	pushq %r15\n"
+"	subq $8, %rsp\n"
+"	stmxcsr (%rsp)\n"
+"	fnstcw 4(%rsp)\n"
+"	movq %rsp, (%rdi)\n"
+"	movq %rsi, %rsp\n"
+"	ldmxcsr (%rsp)\n"
+"	fldcw 4(%rsp)\n"
+"	addq $8, %rsp\n"
+"	popq %r15\n"
+"	popq %r14\n"
+"	popq %r13\n"
+"	popq %r12\n"
+"	popq %rbx\n"
+"	popq %rbp\n"
+"	ret\n"
+"	.size model_context_switch, .-model_context_switch\n"
+"\n"
+"	.globl model_context_start\n"
+"	.type model_context_start, @function\n"
+"model_context_start:\n"
+"	.cfi_startproc\n"
+"	.cfi_undefined rip\n"
+"	callq *%r12\n"
+"	movq %r13, %rdi\n"
+"	callq model_context_exit\n"
+"	ud2\n"
+"	.cfi_endproc\n"
+"	.size model_context_start, .-model_context_start\n"
+);
+
+#define FRAME_WORDS 10
+
+static void init_frame(uint64_t *frame, void (*func)(), model_context_t *link)
+{
+	uint32_t mxcsr;
+	uint16_t fcw;
+	asm volatile("stmxcsr %0\n\tfnstcw %1" : "=m" (mxcsr), "=m" (fcw));
+	memcpy(&frame[0], &mxcsr, sizeof(mxcsr));
+	memcpy((char *)&frame[0] + 4, &fcw, sizeof(fcw));
+	frame[3] = (uint64_t)link;		/* r13 */
+	frame[4] = (uint64_t)func;		/* r12 */
+	frame[7] = (uint64_t)model_context_start;	/* return address */
+	/* frame[8..9]: padding, so that func is called with an aligned stack */
+}
+
+#elif defined(__aarch64__)
+
+/*
+ * Saved frame, from the stack pointer up: x19-x28, x29 (frame pointer), x30
+ * (link register), d8-d15, FPCR, padding. A new context's frame holds its
+ * function in x19 and its link in x20.
+ */
+asm(
+"	.text\n"
+"	.globl model_context_switch\n"
+"	.type model_context_switch, %function\n"
+"model_context_switch:\n"
+"	sub sp, sp, #176\n"
+"	stp x19, x20, [sp, #0]\n"
+"	stp x21, x22, [sp, #16]\n"
+"	stp x23, x24, [sp, #32]\n"
+"	stp x25, x26, [sp, #48]\n"
+"	stp x27, x28, [sp, #64]\n"
+"	stp x29, x30, [sp, #80]\n"
+"	stp d8, d9, [sp, #96]\n"
+"	stp d10, d11, [sp, #112]\n"
+"	stp d12, d13, [sp, #128]\n"
+"	stp d14, d15, [sp, #144]\n"
+"	mrs x9, fpcr\n"
+"	str x9, [sp, #160]\n"
+"	mov x9, sp\n"
+"	str x9, [x0]\n"
+"	mov sp, x1\n"
+"	ldp x19, x20, [sp, #0]\n"
+"	ldp x21, x22, [sp, #16]\n"
+"	ldp x23, x24, [sp, #32]\n"
+"	ldp x25, x26, [sp, #48]\n"
+"	ldp x27, x28, [sp, #64]\n"
+"	ldp x29, x30, [sp, #80]\n"
+"	ldp d8, d9, [sp, #96]\n"
+"	ldp d10, d11, [sp, #112]\n"
+"	ldp d12, d13, [sp, #128]\n"
+"	ldp d14, d15, [sp, #144]\n"
+"	ldr x9, [sp, #160]\n"
+"	msr fpcr, x9\n"
+"	add sp, sp, #176\n"
+"	ret\n"
+"	.size model_context_switch, .-model_context_switch\n"
+"\n"
+"	.globl model_context_start\n"
+"	.type model_context_start, %function\n"
+"model_context_start:\n"
+"	.cfi_startproc\n"
+"	.cfi_undefined x30\n"
+"	blr x19\n"
+"	mov x0, x20\n"
+"	bl model_context_exit\n"
+"	brk #0\n"
+"	.cfi_endproc\n"
+"	.size model_context_start, .-model_context_start\n"
+);
+
+#define FRAME_WORDS 22
+
+static void init_frame(uint64_t *frame, void (*func)(), model_context_t *link)
+{
+	uint64_t fpcr;
+	asm volatile("mrs %0, fpcr" : "=r" (fpcr));
+	frame[0] = (uint64_t)func;		/* x19 */
+	frame[1] = (uint64_t)link;		/* x20 */
+	frame[11] = (uint64_t)model_context_start;	/* x30 */
+	frame[20] = fpcr;
+}
+
+#else
+#error "USE_FAST_CONTEXT is not supported on this architecture"
+#endif
+
+/** Runs when a context's function returns: continue with its link */
+void model_context_exit(model_context_t *link)
+{
+	model_context_t dead;
+	model_swapcontext(&dead, link);
+}
+
+int model_swapcontext(model_context_t *oucp, model_context_t *ucp)
+{
+	model_context_switch(&oucp->sp, ucp->sp);
+	return 0;
+}
+
+/**
+ * @brief Create a new context, with a given stack and entry function
+ *
+ * Counterpart of getcontext() + makecontext(): the first switch to ucp calls
+ * func on the given stack, and when func returns the context switches to
+ * link.
+ *
+ * @return 0 on success (it cannot fail)
+ */
+int model_makecontext(model_context_t *ucp, void *stack, size_t stacksize,
+		void (*func)(), model_context_t *link)
+{
+	uintptr_t top = ((uintptr_t)stack + stacksize) & ~(uintptr_t)15;
+	uint64_t *frame = (uint64_t *)top - FRAME_WORDS;
+	memset(frame, 0, FRAME_WORDS * sizeof(uint64_t));
+	init_frame(frame, func, link);
+	ucp->sp = frame;
+	return 0;
+}
+
+#else /* !USE_FAST_CONTEXT */
+
+/**
+ * @brief Create a new context, with a given stack and entry function
+ * @return 0 on success; otherwise, the error from getcontext()
+ */
+int model_makecontext(model_context_t *ucp, void *stack, size_t stacksize,
+		void (*func)(), model_context_t *link)
+{
+	int ret = getcontext(ucp);
+	if (ret)
+		return ret;
+	ucp->uc_stack.ss_sp = stack;
+	ucp->uc_stack.ss_size = stacksize;
+	ucp->uc_stack.ss_flags = 0;
+	ucp->uc_link = link;
+	makecontext(ucp, func, 0);
+	return 0;
+}
+
+#endif /* !USE_FAST_CONTEXT */
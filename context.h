@@ -6,8 +6,11 @@
 #ifndef __CONTEXT_H__
 #define __CONTEXT_H__
 
+#include <stddef.h>
 #include <ucontext.h>
 
+#include "config.h"
+
 #ifdef MAC
 
 int model_swapcontext(ucontext_t *oucp, ucontext_t *ucp);
@@ -21,4 +24,29 @@ static inline int model_swapcontext(ucontext_t *oucp, ucontext_t *ucp)
 
 #endif /* !MAC */
 
+#if USE_FAST_CONTEXT
+
+/**
+ * @brief A user thread (or model checker) context
+ *
+ * The callee-saved registers of a suspended context are pushed on its own
+ * stack, so all that is kept here is its stack pointer. The signal mask is
+ * left alone: it is the same for every thread, and no thread switch happens
+ * from within a signal handler.
+ */
+typedef struct model_context {
+	void *sp;
+} model_context_t;
+
+int model_swapcontext(model_context_t *oucp, model_context_t *ucp);
+
+#else /* !USE_FAST_CONTEXT */
+
+typedef ucontext_t model_context_t;
+
+#endif /* !USE_FAST_CONTEXT */
+
+int model_makecontext(model_context_t *ucp, void *stack, size_t stacksize,
+		void (*func)(), model_context_t *link);
+
 #endif /* __CONTEXT_H__ */
@@ -6,7 +6,7 @@
 
 /** Initializes a CycleGraph object. */
 CycleGraph::CycleGraph() :
-	discovered(new HashTable<const CycleNode *, const CycleNode *, uintptr_t, 4, model_malloc, model_calloc, model_free>(16)),
+	searches(0),
 	queue(new ModelVector<const CycleNode *>()),
 	hasCycles(false),
 	oldCycles(false)
@@ -17,7 +17,6 @@ CycleGraph::CycleGraph() :
 CycleGraph::~CycleGraph()
 {
 	delete queue;
-	delete discovered;
 }
 
 /**
@@ -52,7 +51,7 @@ void CycleGraph::putNode(const Promise *promise, CycleNode *node)
  */
 void CycleGraph::erasePromiseNode(const Promise *promise)
 {
-	promiseToNode.put(promise, NULL);
+	promiseToNode.remove(promise);
 #if SUPPORT_MOD_ORDER_DUMP
 	/* Remove the promise node from nodeList */
 	CycleNode *node = getNode_noCreate(promise);
@@ -394,10 +393,10 @@ void CycleGraph::dumpGraphToFile(const char *filename) const
  */
 bool CycleGraph::checkReachable(const CycleNode *from, const CycleNode *to) const
 {
-	discovered->reset();
+	unsigned int search = ++searches;
 	queue->clear();
 	queue->push_back(from);
-	discovered->put(from, from);
+	from->discover(search);
 	while (!queue->empty()) {
 		const CycleNode *node = queue->back();
 		queue->pop_back();
@@ -405,10 +404,8 @@ bool CycleGraph::checkReachable(const CycleNode *from, const CycleNode *to) cons
 			return true;
 		for (unsigned int i = 0; i < node->getNumEdges(); i++) {
 			CycleNode *next = node->getEdge(i);
-			if (!discovered->contains(next)) {
-				discovered->put(next, next);
+			if (next->discover(search))
 				queue->push_back(next);
-			}
 		}
 	}
 	return false;
@@ -444,12 +441,12 @@ template bool CycleGraph::checkReachable(const Promise *from,
 /** @return True, if the promise has failed; false otherwise */
 bool CycleGraph::checkPromise(const ModelAction *fromact, Promise *promise) const
 {
-	discovered->reset();
+	unsigned int search = ++searches;
 	queue->clear();
 	CycleNode *from = actionToNode.get(fromact);
 
 	queue->push_back(from);
-	discovered->put(from, from);
+	from->discover(search);
 	while (!queue->empty()) {
 		const CycleNode *node = queue->back();
 		queue->pop_back();
@@ -462,10 +459,8 @@ bool CycleGraph::checkPromise(const ModelAction *fromact, Promise *promise) cons
 
 		for (unsigned int i = 0; i < node->getNumEdges(); i++) {
 			CycleNode *next = node->getEdge(i);
-			if (!discovered->contains(next)) {
-				discovered->put(next, next);
+			if (next->discover(search))
 				queue->push_back(next);
-			}
 		}
 	}
 	return false;
@@ -514,7 +509,8 @@ bool CycleGraph::checkForCycles() const
 CycleNode::CycleNode(const ModelAction *act) :
 	action(act),
 	promise(NULL),
-	hasRMW(NULL)
+	hasRMW(NULL),
+	discovered(0)
 {
 }
 
@@ -525,7 +521,8 @@ CycleNode::CycleNode(const ModelAction *act) :
 CycleNode::CycleNode(const Promise *promise) :
 	action(NULL),
 	promise(promise),
-	hasRMW(NULL)
+	hasRMW(NULL),
+	discovered(0)
 {
 }
 
@@ -13,6 +13,7 @@
 #include <stdio.h>
 
 #include "hashtable.h"
+#include "actionmap.h"
 #include "config.h"
 #include "mymemory.h"
 #include "stl-model.h"
@@ -65,12 +66,13 @@ class CycleGraph {
 	CycleNode * getNode_noCreate(const Promise *promise) const;
 	bool mergeNodes(CycleNode *node1, CycleNode *node2);
 
-	HashTable<const CycleNode *, const CycleNode *, uintptr_t, 4, model_malloc, model_calloc, model_free> *discovered;
+	/** @brief The number of graph searches so far; see CycleNode::discover() */
+	mutable unsigned int searches;
 	ModelVector<const CycleNode *> * queue;
 
 
 	/** @brief A table for mapping ModelActions to CycleNodes */
-	HashTable<const ModelAction *, CycleNode *, uintptr_t, 4> actionToNode;
+	ActionMap<CycleNode *> actionToNode;
 	/** @brief A table for mapping Promises to CycleNodes */
 	HashTable<const Promise *, CycleNode *, uintptr_t, 4> promiseToNode;
 
@@ -113,6 +115,18 @@ class CycleNode {
 	bool is_promise() const { return !action; }
 	void resolvePromise(const ModelAction *writer);
 
+	/**
+	 * @brief Mark this node as discovered by a graph search
+	 * @param search The ID of the search
+	 * @return True, if the node was not yet discovered by this search
+	 */
+	bool discover(unsigned int search) const {
+		if (discovered == search)
+			return false;
+		discovered = search;
+		return true;
+	}
+
 	SNAPSHOTALLOC
  private:
 	/** @brief The ModelAction that this node represents */
@@ -131,6 +145,9 @@ class CycleNode {
 	/** Pointer to a RMW node that reads from this node, or NULL, if none
 	 * exists */
 	CycleNode *hasRMW;
+
+	/** @brief The last graph search which discovered this node */
+	mutable unsigned int discovered;
 };
 
 #endif /* __CYCLEGRAPH_H__ */
@@ -3,17 +3,114 @@
 #include "threads-model.h"
 #include <stdio.h>
 #include <cstring>
+#include <sys/mman.h>
 #include "mymemory.h"
 #include "clockvector.h"
 #include "config.h"
 #include "action.h"
 #include "execution.h"
 #include "stl-model.h"
+#include "hashtable.h"
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <link.h>
+#include <algorithm>
+#include <time.h>
 
-static struct ShadowTable *root;
 static SnapVector<DataRace *> *unrealizedraces;
-static void *memory_base;
-static void *memory_top;
+
+/** @brief Race detector cost counters, for the end-of-run statistics */
+struct RaceStats {
+	/** @brief Shadow regions reserved */
+	unsigned int regions;
+	/** @brief Words checked on a single inline cell */
+	uint64_t shortchecks;
+	/** @brief Words checked byte by byte or against a read vector */
+	uint64_t fullchecks;
+	/** @brief Words of a range check copied from the previous word */
+	uint64_t copiedwords;
+	/** @brief Cells split into per-byte cells */
+	uint64_t splits;
+	/** @brief Read vectors allocated (including regrowing) */
+	uint64_t readvectors;
+	/** @brief Races found, including repeats of earlier reports */
+	uint64_t found;
+	/** @brief Races found while the prefix was not yet feasible */
+	uint64_t queued;
+	/** @brief Races asserted as new bugs */
+	uint64_t realized;
+	/** @brief Race checks (single accesses and ranges) */
+	uint64_t checks;
+	/** @brief Time spent in race checks, in nanoseconds */
+	uint64_t checktime;
+};
+
+/** @brief The statistics being collected, or NULL if they are not */
+static struct RaceStats *racestats;
+
+#define RACESTAT(field) do { if (racestats) racestats->field++; } while (0)
+
+/**
+ * @brief A race reported in some execution, kept (without snapshotting) for
+ * the rest of the model-checking run
+ *
+ * Races are identified by the word they happen on, the sites of their two
+ * accesses and the kinds of access (read or write, atomic or not). Every
+ * execution that realizes a race is still a buggy one; the reports only keep
+ * the summary printed at the end from repeating the same race.
+ */
+struct RaceReport {
+	/** @brief The address of the race, the first time it was realized */
+	const void *address;
+	const void *oldsite;
+	const void *newsite;
+	bool isoldwrite;
+	bool isnewwrite;
+	bool isoldatomic;
+	bool isnewatomic;
+	/** @brief The number of times the race was realized */
+	unsigned int count;
+	/** @brief The next report with the same newsite */
+	struct RaceReport *next;
+};
+
+/** @brief The race reports, chained by the site of their second access */
+static HashTable<const void *, struct RaceReport *, uintptr_t, 4, model_malloc, model_calloc, model_free> *racereports;
+/** @brief The race reports, in the order they were first realized */
+static ModelVector<struct RaceReport *> *racereportlist;
+
+/** @brief The call site of the access currently being checked */
+static const void *accesssite;
+
+/** @brief A range of addresses, [start, end) */
+struct AddressRange {
+	uintptr_t start;
+	uintptr_t end;
+};
+
+/** @brief The memory whose accesses are not checked (see loadRaceSuppressions) */
+static ModelVector<struct AddressRange> *suppressedmemory;
+/** @brief The code whose accesses are not checked, sorted and disjoint */
+static ModelVector<struct AddressRange> *suppressedsites;
+
+/** @brief The size of the shadow memory for one region */
+#define SHADOWREGIONBYTES (SHADOWREGIONSIZE / SHADOWWORD * sizeof(struct ShadowCell))
+
+/**
+ * @brief The shadow regions reserved so far, indexed by the high bits of the
+ * addresses they shadow
+ *
+ * Shadow memory lives outside the snapshotting heap: it is reserved with
+ * mmap(MAP_NORESERVE), so only the pages actually touched are ever
+ * committed, and it is cleared explicitly by resetRaceDetector() instead of
+ * being saved and restored with every snapshot.
+ */
+static char *shadowregions[NUMSHADOWREGIONS];
+/** @brief The indices of the reserved regions in shadowregions */
+static ModelVector<unsigned int> *reservedregions;
+
+static void markSuppressedMemory();
+static void splitCell(struct ShadowCell *cell);
 
 static const ModelExecution * get_execution()
 {
@@ -23,40 +120,257 @@ static const ModelExecution * get_execution()
 /** This function initialized the data race detector. */
 void initRaceDetector()
 {
-	root = (struct ShadowTable *)snapshot_calloc(sizeof(struct ShadowTable), 1);
-	memory_base = snapshot_calloc(sizeof(struct ShadowBaseTable) * SHADOWBASETABLES, 1);
-	memory_top = ((char *)memory_base) + sizeof(struct ShadowBaseTable) * SHADOWBASETABLES;
 	unrealizedraces = new SnapVector<DataRace *>();
+	reservedregions = new ModelVector<unsigned int>();
+	racereports = new HashTable<const void *, struct RaceReport *, uintptr_t, 4, model_malloc, model_calloc, model_free>();
+	racereportlist = new ModelVector<struct RaceReport *>();
+	suppressedmemory = new ModelVector<struct AddressRange>();
+	suppressedsites = new ModelVector<struct AddressRange>();
 }
 
-void * table_calloc(size_t size)
+/**
+ * Clears all shadow memory. Must be called whenever the program is rolled
+ * back to its initial state.
+ */
+void resetRaceDetector()
 {
-	if ((((char *)memory_base) + size) > memory_top) {
-		return snapshot_calloc(size, 1);
-	} else {
-		void *tmp = memory_base;
-		memory_base = ((char *)memory_base) + size;
-		return tmp;
+	for (unsigned int i = 0; i < reservedregions->size(); i++)
+		madvise(shadowregions[(*reservedregions)[i]], SHADOWREGIONBYTES, MADV_DONTNEED);
+	markSuppressedMemory();
+}
+
+/** Starts collecting the statistics printed by printRaceStats() */
+void enableRaceStats()
+{
+	racestats = (struct RaceStats *)model_calloc(1, sizeof(struct RaceStats));
+}
+
+/** @return The current time, in nanoseconds, if timing race checks */
+static inline uint64_t raceStatsStart()
+{
+	if (!racestats)
+		return 0;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/** Adds the time since start to the time spent in race checks */
+static inline void raceStatsStop(uint64_t start)
+{
+	if (!racestats)
+		return;
+	racestats->checks++;
+	racestats->checktime += raceStatsStart() - start;
+}
+
+/** Prints the statistics collected since enableRaceStats() */
+void printRaceStats()
+{
+	if (!racestats)
+		return;
+	struct RaceStats *stats = racestats;
+	model_print("Race detector shadow regions: %u (%lu MB reserved)\n",
+			stats->regions, (unsigned long)(stats->regions * (SHADOWREGIONBYTES >> 20)));
+	model_print("Race detector word checks: %llu short, %llu full, %llu copied\n",
+			(unsigned long long)stats->shortchecks, (unsigned long long)stats->fullchecks,
+			(unsigned long long)stats->copiedwords);
+	model_print("Race detector cells split: %llu, read vectors allocated: %llu\n",
+			(unsigned long long)stats->splits, (unsigned long long)stats->readvectors);
+	model_print("Races found: %llu (%llu before feasible), realized: %llu\n",
+			(unsigned long long)stats->found, (unsigned long long)stats->queued,
+			(unsigned long long)stats->realized);
+	model_print("Race checks: %llu in %.3f s (%.1f ns each)\n",
+			(unsigned long long)stats->checks, stats->checktime / 1e9,
+			stats->checks ? (double)stats->checktime / stats->checks : 0.0);
+}
+
+/** Reserves the shadow region for the given region index */
+static char * reserveShadowRegion(uintptr_t index)
+{
+	void *region = mmap(NULL, SHADOWREGIONBYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (region == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+	shadowregions[index] = (char *)region;
+	reservedregions->push_back(index);
+	RACESTAT(regions);
+	return (char *)region;
+}
+
+/** @return The shadow region for the given address */
+static inline char * lookupShadowRegion(const void *address)
+{
+	uintptr_t index = ((uintptr_t)address) >> SHADOWREGIONBITS;
+	ASSERT(index < NUMSHADOWREGIONS);
+	char *region = shadowregions[index];
+	if (region == NULL)
+		region = reserveShadowRegion(index);
+	return region;
+}
+
+/** This function looks up the cell in the shadow memory corresponding to the
+ * word containing a given address.*/
+static inline struct ShadowCell * lookupAddressEntry(const void *address)
+{
+	return ((struct ShadowCell *)lookupShadowRegion(address)) + ((((uintptr_t)address) & (SHADOWREGIONSIZE - 1)) / SHADOWWORD);
+}
+
+/**
+ * Marks the shadow cells of all suppressed memory as ignored. A word that is
+ * only partly suppressed is split, and only its suppressed bytes' cells are
+ * marked, so that its other bytes are still checked.
+ */
+static void markSuppressedMemory()
+{
+	for (unsigned int i = 0; i < suppressedmemory->size(); i++) {
+		struct AddressRange range = (*suppressedmemory)[i];
+		for (uintptr_t word = range.start & ~(uintptr_t)WORDMASK; word < range.end; word += SHADOWWORD) {
+			struct ShadowCell *cell = lookupAddressEntry((void *)word);
+			unsigned int mask = 0xff;
+			if (range.start > word)
+				mask &= 0xff << (range.start - word);
+			if (range.end < word + SHADOWWORD)
+				mask &= 0xff >> (word + SHADOWWORD - range.end);
+			if (ISIGNOREDCELL(cell))
+				continue;
+			if (mask == 0xff) {
+				/* No accesses have been recorded yet */
+				if (ISSPLITCELL(cell))
+					snapshot_free(SPLITCELLS(cell));
+				cell->write = IGNOREDCELL;
+				cell->read = 0;
+				continue;
+			}
+			if (!ISSPLITCELL(cell))
+				splitCell(cell);
+			struct ShadowCell *bytes = SPLITCELLS(cell);
+			for (int j = 0; j < SHADOWWORD; j++) {
+				if (mask & (1 << j)) {
+					bytes[j].write = IGNOREDCELL;
+					bytes[j].read = 0;
+				}
+			}
+		}
+	}
+}
+
+/** @return Whether accesses made from site are suppressed */
+static inline bool isSuppressedSite(const void *site)
+{
+	unsigned int num = suppressedsites->size();
+	if (num == 0)
+		return false;
+	/* Binary search for the last range starting at or before site */
+	unsigned int low = 0, high = num;
+	while (high - low > 1) {
+		unsigned int mid = (low + high) / 2;
+		if ((*suppressedsites)[mid].start <= (uintptr_t)site)
+			low = mid;
+		else
+			high = mid;
 	}
+	return (*suppressedsites)[low].start <= (uintptr_t)site && (uintptr_t)site < (*suppressedsites)[low].end;
 }
 
-/** This function looks up the entry in the shadow table corresponding to a
- * given address.*/
-static uint64_t * lookupAddressEntry(const void *address)
+static bool rangeBefore(const struct AddressRange &a, const struct AddressRange &b)
+{
+	return a.start < b.start;
+}
+
+/**
+ * Resolves a suppression rule's target: either a symbol (whose extent comes
+ * from the dynamic symbol table) or a pair of addresses.
+ * @return False if the target cannot be resolved
+ */
+static bool parseSuppressionRange(char *arg1, char *arg2, struct AddressRange *range)
 {
-	struct ShadowTable *currtable = root;
-#if BIT48
-	currtable = (struct ShadowTable *) currtable->array[(((uintptr_t)address) >> 32) & MASK16BIT];
-	if (currtable == NULL) {
-		currtable = (struct ShadowTable *)(root->array[(((uintptr_t)address) >> 32) & MASK16BIT] = table_calloc(sizeof(struct ShadowTable)));
+	char *end;
+	if (arg2 != NULL) {
+		range->start = strtoull(arg1, &end, 0);
+		if (*end != '\0')
+			return false;
+		range->end = strtoull(arg2, &end, 0);
+		return *end == '\0' && range->start < range->end;
 	}
-#endif
 
-	struct ShadowBaseTable *basetable = (struct ShadowBaseTable *)currtable->array[(((uintptr_t)address) >> 16) & MASK16BIT];
-	if (basetable == NULL) {
-		basetable = (struct ShadowBaseTable *)(currtable->array[(((uintptr_t)address) >> 16) & MASK16BIT] = table_calloc(sizeof(struct ShadowBaseTable)));
+	void *addr = dlsym(RTLD_DEFAULT, arg1);
+	Dl_info info;
+	const ElfW(Sym) *sym = NULL;
+	if (addr == NULL || !dladdr1(addr, &info, (void **)&sym, RTLD_DL_SYMENT) || sym == NULL)
+		return false;
+	range->start = (uintptr_t)addr;
+	/* Include the end, as a call site is the return address of a call */
+	range->end = range->start + (sym->st_size ? sym->st_size : 1) + 1;
+	return true;
+}
+
+/**
+ * @brief Load race suppressions from a file
+ *
+ * Each line of the file is a rule (blank lines and lines starting with '#'
+ * are ignored):
+ *
+ *     memory SYMBOL        Accesses to the object SYMBOL are not checked
+ *     memory START END     Accesses to addresses in [START, END) are not checked
+ *     site SYMBOL          Accesses made from function SYMBOL are not checked
+ *     site START END       Accesses made from code in [START, END) are not checked
+ *
+ * Symbols must be in the dynamic symbol table (e.g., link with -rdynamic).
+ * Suppressed memory is marked in the shadow cells themselves, so checks bail
+ * out on their first lookup (or, for a partly suppressed word, skip its
+ * suppressed bytes); suppressed sites are checked once per access.
+ * Exits on a malformed or unresolvable rule.
+ */
+void loadRaceSuppressions(const char *filename)
+{
+	FILE *file = fopen(filename, "r");
+	if (file == NULL) {
+		perror(filename);
+		exit(EXIT_FAILURE);
+	}
+
+	char line[256];
+	for (int linenum = 1; fgets(line, sizeof(line), file) != NULL; linenum++) {
+		char *saveptr;
+		char *kind = strtok_r(line, " \t\r\n", &saveptr);
+		if (kind == NULL || kind[0] == '#')
+			continue;
+		char *arg1 = strtok_r(NULL, " \t\r\n", &saveptr);
+		char *arg2 = strtok_r(NULL, " \t\r\n", &saveptr);
+		struct AddressRange range;
+		bool ismemory = strcmp(kind, "memory") == 0;
+		if ((!ismemory && strcmp(kind, "site") != 0) || arg1 == NULL ||
+				strtok_r(NULL, " \t\r\n", &saveptr) != NULL ||
+				!parseSuppressionRange(arg1, arg2, &range)) {
+			model_print("%s:%d: invalid race suppression\n", filename, linenum);
+			exit(EXIT_FAILURE);
+		}
+		if (ismemory) {
+			/* Symbols' ranges include one byte too many for objects */
+			if (arg2 == NULL)
+				range.end--;
+			suppressedmemory->push_back(range);
+		} else {
+			suppressedsites->push_back(range);
+		}
+	}
+	fclose(file);
+
+	/* Sort and merge the site ranges, for binary search */
+	std::sort(suppressedsites->begin(), suppressedsites->end(), rangeBefore);
+	unsigned int num = 0;
+	for (unsigned int i = 0; i < suppressedsites->size(); i++) {
+		struct AddressRange range = (*suppressedsites)[i];
+		if (num > 0 && range.start <= (*suppressedsites)[num - 1].end)
+			(*suppressedsites)[num - 1].end = std::max((*suppressedsites)[num - 1].end, range.end);
+		else
+			(*suppressedsites)[num++] = range;
 	}
-	return &basetable->array[((uintptr_t)address) & MASK16BIT];
+	suppressedsites->resize(num);
+
+	markSuppressedMemory();
 }
 
 /**
@@ -74,49 +388,186 @@ static bool clock_may_race(ClockVector *clock1, thread_id_t tid1,
 	return tid1 != tid2 && clock2 != 0 && clock1->getClock(tid2) <= clock2;
 }
 
+/** @return The read vector for a (non-epoch) read field */
+static inline struct ReadVector * getReadVector(uint64_t read)
+{
+	return (struct ReadVector *)read;
+}
+
+/** Allocates a read vector with room for capacity reads */
+static struct ReadVector * allocReadVector(int capacity)
+{
+	struct ReadVector *vec = (struct ReadVector *)snapshot_malloc(sizeof(struct ReadVector) + (capacity - 1) * sizeof(struct ReadEntry));
+	RACESTAT(readvectors);
+	vec->numReads = 0;
+	vec->capacity = capacity;
+	return vec;
+}
+
+/** Frees the read vector of a cell, if it has one */
+static void freeReads(uint64_t read)
+{
+	if (read != 0 && !ISREADEPOCH(read))
+		snapshot_free(getReadVector(read));
+}
+
+/** Makes dst a copy of the (non-split) cell src, covering the bytes in mask */
+static void copyCell(struct ShadowCell *dst, const struct ShadowCell *src, unsigned int mask)
+{
+	dst->write = (src->write & ~(0xffULL << 1)) | (((uint64_t)mask) << 1);
+	dst->read = src->read;
+	dst->writesite = src->writesite;
+	dst->readsite = src->readsite;
+	if (src->read != 0 && !ISREADEPOCH(src->read)) {
+		struct ReadVector *vec = getReadVector(src->read);
+		struct ReadVector *copy = allocReadVector(vec->capacity);
+		copy->numReads = vec->numReads;
+		std::memcpy(copy->reads, vec->reads, vec->numReads * sizeof(struct ReadEntry));
+		dst->read = (uint64_t)copy;
+	}
+}
+
 /**
- * Expands a record from the compact form to the full form.  This is
- * necessary for multiple readers or for very large thread ids or time
- * stamps. */
-static void expandRecord(uint64_t *shadow)
-{
-	uint64_t shadowval = *shadow;
-
-	modelclock_t readClock = READVECTOR(shadowval);
-	thread_id_t readThread = int_to_id(RDTHREADID(shadowval));
-	modelclock_t writeClock = WRITEVECTOR(shadowval);
-	thread_id_t writeThread = int_to_id(WRTHREADID(shadowval));
-
-	struct RaceRecord *record = (struct RaceRecord *)snapshot_calloc(1, sizeof(struct RaceRecord));
-	record->writeThread = writeThread;
-	record->writeClock = writeClock;
-
-	if (readClock != 0) {
-		record->capacity = INITCAPACITY;
-		record->thread = (thread_id_t *)snapshot_malloc(sizeof(thread_id_t) * record->capacity);
-		record->readClock = (modelclock_t *)snapshot_malloc(sizeof(modelclock_t) * record->capacity);
-		record->numReads = 1;
-		record->thread[0] = readThread;
-		record->readClock[0] = readClock;
+ * Splits a word's shared cell into one cell per byte. This is necessary once
+ * the bytes of the word have different access histories.
+ */
+static void splitCell(struct ShadowCell *cell)
+{
+	unsigned int mask = BYTEMASK(cell->write);
+	struct ShadowCell *bytes = (struct ShadowCell *)snapshot_calloc(SHADOWWORD, sizeof(struct ShadowCell));
+	RACESTAT(splits);
+	for (int i = 0; i < SHADOWWORD; i++)
+		if (mask & (1 << i))
+			copyCell(&bytes[i], cell, 1 << i);
+	freeReads(cell->read);
+	cell->write = ENCODESPLIT(bytes);
+	cell->read = 0;
+	cell->writesite = NULL;
+	cell->readsite = NULL;
+}
+
+/**
+ * After a write to the bytes in mask of a split word, collapses the word back
+ * to a single cell if the written bytes now share the same epochs (and
+ * sites) and the remaining bytes have never been accessed.
+ */
+static void tryMergeCell(struct ShadowCell *cell, unsigned int mask)
+{
+	struct ShadowCell *bytes = SPLITCELLS(cell);
+	uint64_t write = 0;
+	const void *writesite = NULL;
+	for (int i = 0; i < SHADOWWORD; i++) {
+		/* Suppressed bytes keep the word split */
+		if (ISIGNOREDCELL(&bytes[i]))
+			return;
+		if (!(mask & (1 << i))) {
+			if (bytes[i].write != 0)
+				return;
+			continue;
+		}
+		/* An atomic write may leave concurrent accesses behind */
+		if (bytes[i].read != 0)
+			return;
+		uint64_t val = (bytes[i].write & ~(0xffULL << 1)) | (((uint64_t)mask) << 1);
+		if (write != 0 && (write != val || writesite != bytes[i].writesite))
+			return;
+		write = val;
+		writesite = bytes[i].writesite;
 	}
-	*shadow = (uint64_t) record;
+	snapshot_free(bytes);
+	cell->write = write;
+	cell->read = 0;
+	cell->writesite = writesite;
+	cell->readsite = NULL;
 }
 
-/** This function is called when we detect a data race.*/
-static void reportDataRace(thread_id_t oldthread, modelclock_t oldclock, bool isoldwrite, ModelAction *newaction, bool isnewwrite, const void *address)
+/** @return A description of a kind of access, for race reports */
+static const char * accessName(bool iswrite, bool isatomic)
 {
-	struct DataRace *race = (struct DataRace *)snapshot_malloc(sizeof(struct DataRace));
-	race->oldthread = oldthread;
-	race->oldclock = oldclock;
-	race->isoldwrite = isoldwrite;
-	race->newaction = newaction;
-	race->isnewwrite = isnewwrite;
-	race->address = address;
-	unrealizedraces->push_back(race);
+	if (isatomic)
+		return iswrite ? "atomic write" : "atomic read";
+	return iswrite ? "write" : "read";
+}
 
-	/* If the race is realized, bail out now. */
-	if (checkDataRaces())
-		model->switch_to_master(NULL);
+/** @return The report for a race on the same word, or NULL if it is new */
+static struct RaceReport * findRaceReport(const void *address, const void *oldsite, const void *newsite, bool isoldwrite, bool isnewwrite, bool isoldatomic, bool isnewatomic)
+{
+	uintptr_t word = (uintptr_t)address & ~(uintptr_t)WORDMASK;
+	for (struct RaceReport *report = racereports->get(newsite); report != NULL; report = report->next)
+		if (((uintptr_t)report->address & ~(uintptr_t)WORDMASK) == word &&
+				report->oldsite == oldsite && report->isoldwrite == isoldwrite && report->isnewwrite == isnewwrite &&
+				report->isoldatomic == isoldatomic && report->isnewatomic == isnewatomic)
+			return report;
+	return NULL;
+}
+
+/** Counts a realized race in the reports, adding a report if it is new */
+static void recordRaceReport(struct DataRace *race)
+{
+	struct RaceReport *report = findRaceReport(race->address, race->oldsite, race->newsite, race->isoldwrite, race->isnewwrite, race->isoldatomic, race->isnewatomic);
+	if (report != NULL) {
+		report->count++;
+		return;
+	}
+	report = (struct RaceReport *)model_malloc(sizeof(struct RaceReport));
+	report->address = race->address;
+	report->oldsite = race->oldsite;
+	report->newsite = race->newsite;
+	report->isoldwrite = race->isoldwrite;
+	report->isnewwrite = race->isnewwrite;
+	report->isoldatomic = race->isoldatomic;
+	report->isnewatomic = race->isnewatomic;
+	report->count = 1;
+	report->next = racereports->get(race->newsite);
+	racereports->put(race->newsite, report);
+	racereportlist->push_back(report);
+}
+
+/** Asserts a realized race as a bug of the current execution */
+static void realizeRace(struct DataRace *race)
+{
+	recordRaceReport(race);
+	RACESTAT(realized);
+	assert_race(race);
+}
+
+/**
+ * This function is called when we detect a data race.
+ * @param oldsite The call site recorded with the old access's epoch
+ */
+static void reportDataRace(thread_id_t oldthread, modelclock_t oldclock, const void *oldsite, bool isoldwrite, bool isoldatomic, ModelAction *newaction, bool isnewwrite, bool isnewatomic, const void *address)
+{
+	struct DataRace race;
+	race.oldthread = oldthread;
+	race.oldclock = oldclock;
+	race.isoldwrite = isoldwrite;
+	race.newaction = newaction;
+	race.isnewwrite = isnewwrite;
+	race.address = address;
+	race.isoldatomic = isoldatomic;
+	race.isnewatomic = isnewatomic;
+	race.oldsite = oldsite;
+	race.newsite = accesssite;
+
+	RACESTAT(found);
+	if (!get_execution()->isfeasibleprefix()) {
+		/* Pending promises or release sequences may still make this
+		 * trace infeasible (or, for release sequences, order the two
+		 * accesses): keep the race until checkDataRaces() finds the
+		 * prefix feasible */
+		struct DataRace *pending = (struct DataRace *)snapshot_malloc(sizeof(struct DataRace));
+		*pending = race;
+		unrealizedraces->push_back(pending);
+		RACESTAT(queued);
+		return;
+	}
+
+	/* The race was found with newaction's own clock vector, so on a
+	 * feasible prefix it is realized: bail out now (after flushing any
+	 * races queued while the prefix was not yet feasible). */
+	checkDataRaces();
+	realizeRace(&race);
+	model->switch_to_master(NULL);
 }
 
 /**
@@ -126,17 +577,23 @@ static void reportDataRace(thread_id_t oldthread, modelclock_t oldclock, bool is
  * unrealized data races, asserting any realized ones as execution bugs so that
  * the model-checker will end the execution.
  *
+ * Races are only queued while the prefix is not feasible, so this is called
+ * wherever that may change (when release sequences or promises are resolved,
+ * and at the end of an execution); each queued race is examined once.
+ *
  * @return True if any data races were realized
  */
 bool checkDataRaces()
 {
+	if (unrealizedraces->empty())
+		return false;
 	if (get_execution()->isfeasibleprefix()) {
 		bool race_asserted = false;
 		/* Prune the non-racing unrealized dataraces */
 		for (unsigned i = 0; i < unrealizedraces->size(); i++) {
 			struct DataRace *race = (*unrealizedraces)[i];
 			if (clock_may_race(race->newaction->get_cv(), race->newaction->get_tid(), race->oldclock, race->oldthread)) {
-				assert_race(race);
+				realizeRace(race);
 				race_asserted = true;
 			}
 			snapshot_free(race);
@@ -162,202 +619,472 @@ void assert_race(struct DataRace *race)
 			"    Access 1: %5s in thread %2d @ clock %3u\n"
 			"    Access 2: %5s in thread %2d @ clock %3u",
 			race->address,
-			race->isoldwrite ? "write" : "read",
+			accessName(race->isoldwrite, race->isoldatomic),
 			id_to_int(race->oldthread),
 			race->oldclock,
-			race->isnewwrite ? "write" : "read",
+			accessName(race->isnewwrite, race->isnewatomic),
 			id_to_int(race->newaction->get_tid()),
 			race->newaction->get_seq_number()
 		);
 }
 
-/** This function does race detection for a write on an expanded record. */
-void fullRaceCheckWrite(thread_id_t thread, void *location, uint64_t *shadow, ClockVector *currClock)
+/** Adds an access to the reads of a cell, which may not subsume any of them */
+static void addReadEntry(struct ShadowCell *cell, uint64_t epoch, const void *site)
 {
-	struct RaceRecord *record = (struct RaceRecord *)(*shadow);
+	uint64_t read = cell->read;
+	if (read == 0) {
+		cell->read = epoch;
+		cell->readsite = site;
+		return;
+	}
+	struct ReadVector *vec;
+	if (ISREADEPOCH(read)) {
+		vec = allocReadVector(INITCAPACITY);
+		vec->reads[0].epoch = read;
+		vec->reads[0].site = cell->readsite;
+		vec->numReads = 1;
+		cell->readsite = NULL;
+	} else {
+		vec = getReadVector(read);
+		if (vec->numReads >= vec->capacity) {
+			struct ReadVector *newvec = allocReadVector(vec->capacity * 2);
+			newvec->numReads = vec->numReads;
+			std::memcpy(newvec->reads, vec->reads, vec->numReads * sizeof(struct ReadEntry));
+			snapshot_free(vec);
+			vec = newvec;
+		}
+	}
+	vec->reads[vec->numReads].epoch = epoch;
+	vec->reads[vec->numReads].site = site;
+	vec->numReads++;
+	cell->read = (uint64_t)vec;
+}
 
-	/* Check for datarace against last read. */
+/**
+ * After an atomic write to a cell, keeps the earlier atomic accesses that do
+ * not happen before it: a later non-atomic access may race with them, even
+ * if it happens after the write. The accesses that do happen before the
+ * write are subsumed by it, as for any write.
+ * @param oldcell The cell before the write
+ */
+static void keepConcurrentAtomics(struct ShadowCell *cell, const struct ShadowCell *oldcell, thread_id_t thread, ClockVector *currClock)
+{
+	uint64_t write = oldcell->write;
+	if (ISATOMICWRITE(write) && clock_may_race(currClock, thread, WRITEVECTOR(write), int_to_id(WRTHREADID(write))))
+		addReadEntry(cell, ENCODEREAD(WRTHREADID(write), WRITEVECTOR(write)) | ATOMICREAD | WRITEENTRY, oldcell->writesite);
 
-	for (int i = 0; i < record->numReads; i++) {
-		modelclock_t readClock = record->readClock[i];
-		thread_id_t readThread = record->thread[i];
+	uint64_t read = oldcell->read;
+	if (ISREADEPOCH(read)) {
+		if (ISATOMICREAD(read) && clock_may_race(currClock, thread, READVECTOR(read), int_to_id(RDTHREADID(read))))
+			addReadEntry(cell, read, oldcell->readsite);
+	} else if (read != 0) {
+		struct ReadVector *vec = getReadVector(read);
+		for (int i = 0; i < vec->numReads; i++) {
+			uint64_t readEpoch = vec->reads[i].epoch;
+			if (ISATOMICREAD(readEpoch) && clock_may_race(currClock, thread, READVECTOR(readEpoch), int_to_id(RDTHREADID(readEpoch))))
+				addReadEntry(cell, readEpoch, vec->reads[i].site);
+		}
+	}
+}
 
-		/* Note that readClock can't actuall be zero here, so it could be
-			 optimized. */
+/**
+ * This function does race detection for a write on a (non-split) cell.
+ * @param mask The bytes covered by the cell after the write
+ * @param atomic Whether the write is atomic
+ */
+static void cellRaceCheckWrite(thread_id_t thread, const void *location, struct ShadowCell *cell, unsigned int mask, ClockVector *currClock, bool atomic)
+{
+	uint64_t read = cell->read;
 
-		if (clock_may_race(currClock, thread, readClock, readThread)) {
+	/* Check for datarace against last read(s). */
+
+	if (ISREADEPOCH(read)) {
+		modelclock_t readClock = READVECTOR(read);
+		thread_id_t readThread = int_to_id(RDTHREADID(read));
+		if (!(atomic && ISATOMICREAD(read)) && clock_may_race(currClock, thread, readClock, readThread)) {
 			/* We have a datarace */
-			reportDataRace(readThread, readClock, false, get_execution()->get_parent_action(thread), true, location);
+			reportDataRace(readThread, readClock, cell->readsite, ISWRITEENTRY(read), ISATOMICREAD(read), get_execution()->get_parent_action(thread), true, atomic, location);
+		}
+	} else if (read != 0) {
+		struct ReadVector *vec = getReadVector(read);
+		for (int i = 0; i < vec->numReads; i++) {
+			uint64_t readEpoch = vec->reads[i].epoch;
+			modelclock_t readClock = READVECTOR(readEpoch);
+			thread_id_t readThread = int_to_id(RDTHREADID(readEpoch));
+			if (!(atomic && ISATOMICREAD(readEpoch)) && clock_may_race(currClock, thread, readClock, readThread)) {
+				/* We have a datarace */
+				reportDataRace(readThread, readClock, vec->reads[i].site, ISWRITEENTRY(readEpoch), ISATOMICREAD(readEpoch), get_execution()->get_parent_action(thread), true, atomic, location);
+			}
 		}
 	}
 
 	/* Check for datarace against last write. */
 
-	modelclock_t writeClock = record->writeClock;
-	thread_id_t writeThread = record->writeThread;
+	modelclock_t writeClock = WRITEVECTOR(cell->write);
+	thread_id_t writeThread = int_to_id(WRTHREADID(cell->write));
 
-	if (clock_may_race(currClock, thread, writeClock, writeThread)) {
+	if (!(atomic && ISATOMICWRITE(cell->write)) && clock_may_race(currClock, thread, writeClock, writeThread)) {
 		/* We have a datarace */
-		reportDataRace(writeThread, writeClock, true, get_execution()->get_parent_action(thread), true, location);
+		reportDataRace(writeThread, writeClock, cell->writesite, true, ISATOMICWRITE(cell->write), get_execution()->get_parent_action(thread), true, atomic, location);
 	}
 
-	record->numReads = 0;
-	record->writeThread = thread;
-	modelclock_t ourClock = currClock->getClock(thread);
-	record->writeClock = ourClock;
+	/* The write subsumes all earlier accesses, which either happen before
+	 * it or race with it: back to a single epoch (but see
+	 * keepConcurrentAtomics()) */
+	struct ShadowCell oldcell = *cell;
+	cell->read = 0;
+	cell->readsite = NULL;
+	if (atomic)
+		keepConcurrentAtomics(cell, &oldcell, thread, currClock);
+	freeReads(oldcell.read);
+	cell->write = ENCODEWRITE(mask, id_to_int(thread), currClock->getClock(thread)) | (atomic ? ATOMICWRITE : 0);
+	cell->writesite = accesssite;
 }
 
-/** This function does race detection on a write. */
-void raceCheckWrite(thread_id_t thread, void *location)
+/** This function does race detection for a write to the bytes in mask of
+ * the word at address word. */
+static void wordRaceCheckWrite(thread_id_t thread, uintptr_t word, unsigned int mask, ClockVector *currClock, bool atomic)
 {
-	uint64_t *shadow = lookupAddressEntry(location);
-	uint64_t shadowval = *shadow;
-	ClockVector *currClock = get_execution()->get_cv(thread);
+	struct ShadowCell *cell = lookupAddressEntry((void *)word);
 
-	/* Do full record */
-	if (shadowval != 0 && !ISSHORTRECORD(shadowval)) {
-		fullRaceCheckWrite(thread, location, shadow, currClock);
+	if (ISIGNOREDCELL(cell))
 		return;
-	}
 
-	int threadid = id_to_int(thread);
-	modelclock_t ourClock = currClock->getClock(thread);
-
-	/* Thread ID is too large or clock is too large. */
-	if (threadid > MAXTHREADID || ourClock > MAXWRITEVECTOR) {
-		expandRecord(shadow);
-		fullRaceCheckWrite(thread, location, shadow, currClock);
-		return;
+	if (!ISSPLITCELL(cell)) {
+		unsigned int oldmask = BYTEMASK(cell->write);
+		if (!(oldmask & ~mask)) {
+			if (cell->read == 0 || ISREADEPOCH(cell->read))
+				RACESTAT(shortchecks);
+			else
+				RACESTAT(fullchecks);
+			/* The write covers every byte with a history, so one
+			 * cell still describes the whole word */
+			unsigned int first = (oldmask & mask) ? (oldmask & mask) : mask;
+			cellRaceCheckWrite(thread, (void *)(word + __builtin_ctz(first)), cell, mask, currClock, atomic);
+			return;
+		}
+		if (cell->read == 0 && !ISATOMICWRITE(cell->write) == !atomic &&
+				WRTHREADID(cell->write) == (unsigned int)id_to_int(thread) &&
+				WRITEVECTOR(cell->write) == currClock->getClock(thread) &&
+				cell->writesite == accesssite) {
+			/* Same write as the bytes already covered (e.g., the
+			 * rest of a range written in one step): widen the mask */
+			RACESTAT(shortchecks);
+			cell->write |= ((uint64_t)mask) << 1;
+			return;
+		}
+		splitCell(cell);
 	}
 
-	/* Check for datarace against last read. */
+	RACESTAT(fullchecks);
+	struct ShadowCell *bytes = SPLITCELLS(cell);
+	for (int i = 0; i < SHADOWWORD; i++)
+		if ((mask & (1 << i)) && !ISIGNOREDCELL(&bytes[i]))
+			cellRaceCheckWrite(thread, (void *)(word + i), &bytes[i], 1 << i, currClock, atomic);
+	tryMergeCell(cell, mask);
+}
+
+/**
+ * This function does race detection for a read on a (non-split) cell.
+ * @param mask The bytes covered by the cell
+ * @param atomic Whether the read is atomic
+ */
+static void cellRaceCheckRead(thread_id_t thread, const void *location, struct ShadowCell *cell, unsigned int mask, ClockVector *currClock, bool atomic)
+{
+	/* Check for datarace against last write. */
 
-	modelclock_t readClock = READVECTOR(shadowval);
-	thread_id_t readThread = int_to_id(RDTHREADID(shadowval));
+	modelclock_t writeClock = WRITEVECTOR(cell->write);
+	thread_id_t writeThread = int_to_id(WRTHREADID(cell->write));
 
-	if (clock_may_race(currClock, thread, readClock, readThread)) {
+	if (!(atomic && ISATOMICWRITE(cell->write)) && clock_may_race(currClock, thread, writeClock, writeThread)) {
 		/* We have a datarace */
-		reportDataRace(readThread, readClock, false, get_execution()->get_parent_action(thread), true, location);
+		reportDataRace(writeThread, writeClock, cell->writesite, true, ISATOMICWRITE(cell->write), get_execution()->get_parent_action(thread), false, atomic, location);
 	}
 
-	/* Check for datarace against last write. */
-
-	modelclock_t writeClock = WRITEVECTOR(shadowval);
-	thread_id_t writeThread = int_to_id(WRTHREADID(shadowval));
+	uint64_t read = cell->read;
 
-	if (clock_may_race(currClock, thread, writeClock, writeThread)) {
-		/* We have a datarace */
-		reportDataRace(writeThread, writeClock, true, get_execution()->get_parent_action(thread), true, location);
+	/* ... and against the atomic writes kept with the reads */
+	if (!atomic && read != 0) {
+		if (ISREADEPOCH(read)) {
+			if (ISWRITEENTRY(read) && clock_may_race(currClock, thread, READVECTOR(read), int_to_id(RDTHREADID(read))))
+				reportDataRace(int_to_id(RDTHREADID(read)), READVECTOR(read), cell->readsite, true, true, get_execution()->get_parent_action(thread), false, false, location);
+		} else {
+			struct ReadVector *vec = getReadVector(read);
+			for (int i = 0; i < vec->numReads; i++) {
+				uint64_t readEpoch = vec->reads[i].epoch;
+				if (ISWRITEENTRY(readEpoch) && clock_may_race(currClock, thread, READVECTOR(readEpoch), int_to_id(RDTHREADID(readEpoch))))
+					reportDataRace(int_to_id(RDTHREADID(readEpoch)), READVECTOR(readEpoch), vec->reads[i].site, true, true, get_execution()->get_parent_action(thread), false, false, location);
+			}
+		}
 	}
-	*shadow = ENCODEOP(0, 0, threadid, ourClock);
-}
 
-/** This function does race detection on a read for an expanded record. */
-void fullRaceCheckRead(thread_id_t thread, const void *location, uint64_t *shadow, ClockVector *currClock)
-{
-	struct RaceRecord *record = (struct RaceRecord *) (*shadow);
+	cell->write = (cell->write & ~(0xffULL << 1)) | (((uint64_t)mask) << 1);
 
-	/* Check for datarace against last write. */
+	uint64_t ourRead = ENCODEREAD(id_to_int(thread), currClock->getClock(thread)) | (atomic ? ATOMICREAD : 0);
 
-	modelclock_t writeClock = record->writeClock;
-	thread_id_t writeThread = record->writeThread;
+	/*  Note that the following is not really a datarace check as reads
+			cannot actually race.  It is just determining that this read
+			subsumes another in the sense that either this read races or
+			neither read races. An atomic read cannot subsume a non-atomic
+			one, as atomic writes are not checked against it, and no read
+			subsumes an atomic write kept with the reads. */
 
-	if (clock_may_race(currClock, thread, writeClock, writeThread)) {
-		/* We have a datarace */
-		reportDataRace(writeThread, writeClock, true, get_execution()->get_parent_action(thread), false, location);
+	if (read == 0 || ISREADEPOCH(read)) {
+		if (read == 0 || (!clock_may_race(currClock, thread, READVECTOR(read), int_to_id(RDTHREADID(read))) &&
+					!(atomic && !ISATOMICREAD(read)) && !ISWRITEENTRY(read))) {
+			/* Reads are still totally ordered */
+			cell->read = ourRead;
+			cell->readsite = accesssite;
+			return;
+		}
+		/* Concurrent reads: switch to a read vector */
+		struct ReadVector *vec = allocReadVector(INITCAPACITY);
+		vec->reads[0].epoch = read;
+		vec->reads[0].site = cell->readsite;
+		vec->reads[1].epoch = ourRead;
+		vec->reads[1].site = accesssite;
+		vec->numReads = 2;
+		cell->read = (uint64_t)vec;
+		cell->readsite = NULL;
+		return;
 	}
 
 	/* Shorten vector when possible */
 
+	struct ReadVector *vec = getReadVector(read);
 	int copytoindex = 0;
-
-	for (int i = 0; i < record->numReads; i++) {
-		modelclock_t readClock = record->readClock[i];
-		thread_id_t readThread = record->thread[i];
-
-		/*  Note that is not really a datarace check as reads cannott
-				actually race.  It is just determining that this read subsumes
-				another in the sense that either this read races or neither
-				read races. Note that readClock can't actually be zero, so it
-				could be optimized.  */
-
-		if (clock_may_race(currClock, thread, readClock, readThread)) {
+	for (int i = 0; i < vec->numReads; i++) {
+		uint64_t readEpoch = vec->reads[i].epoch;
+		if (clock_may_race(currClock, thread, READVECTOR(readEpoch), int_to_id(RDTHREADID(readEpoch))) ||
+				(atomic && !ISATOMICREAD(readEpoch)) || ISWRITEENTRY(readEpoch)) {
 			/* Still need this read in vector */
-			if (copytoindex != i) {
-				record->readClock[copytoindex] = record->readClock[i];
-				record->thread[copytoindex] = record->thread[i];
-			}
-			copytoindex++;
+			vec->reads[copytoindex++] = vec->reads[i];
 		}
 	}
 
-	if (copytoindex >= record->capacity) {
-		int newCapacity = record->capacity * 2;
-		thread_id_t *newthread = (thread_id_t *)snapshot_malloc(sizeof(thread_id_t) * newCapacity);
-		modelclock_t *newreadClock = (modelclock_t *)snapshot_malloc(sizeof(modelclock_t) * newCapacity);
-		std::memcpy(newthread, record->thread, record->capacity * sizeof(thread_id_t));
-		std::memcpy(newreadClock, record->readClock, record->capacity * sizeof(modelclock_t));
-		snapshot_free(record->readClock);
-		snapshot_free(record->thread);
-		record->readClock = newreadClock;
-		record->thread = newthread;
-		record->capacity = newCapacity;
+	if (copytoindex == 0) {
+		/* This read subsumes all the others: back to an epoch */
+		snapshot_free(vec);
+		cell->read = ourRead;
+		cell->readsite = accesssite;
+		return;
 	}
 
-	modelclock_t ourClock = currClock->getClock(thread);
-
-	record->thread[copytoindex] = thread;
-	record->readClock[copytoindex] = ourClock;
-	record->numReads = copytoindex + 1;
+	if (copytoindex >= vec->capacity) {
+		struct ReadVector *newvec = allocReadVector(vec->capacity * 2);
+		std::memcpy(newvec->reads, vec->reads, copytoindex * sizeof(struct ReadEntry));
+		snapshot_free(vec);
+		vec = newvec;
+		cell->read = (uint64_t)vec;
+	}
+	vec->reads[copytoindex].epoch = ourRead;
+	vec->reads[copytoindex].site = accesssite;
+	vec->numReads = copytoindex + 1;
 }
 
-/** This function does race detection on a read. */
-void raceCheckRead(thread_id_t thread, const void *location)
+/** This function does race detection for a read of the bytes in mask of the
+ * word at address word. */
+static void wordRaceCheckRead(thread_id_t thread, uintptr_t word, unsigned int mask, ClockVector *currClock, bool atomic)
 {
-	uint64_t *shadow = lookupAddressEntry(location);
-	uint64_t shadowval = *shadow;
-	ClockVector *currClock = get_execution()->get_cv(thread);
+	struct ShadowCell *cell = lookupAddressEntry((void *)word);
 
-	/* Do full record */
-	if (shadowval != 0 && !ISSHORTRECORD(shadowval)) {
-		fullRaceCheckRead(thread, location, shadow, currClock);
+	if (ISIGNOREDCELL(cell))
 		return;
+
+	if (!ISSPLITCELL(cell)) {
+		unsigned int oldmask = BYTEMASK(cell->write);
+		modelclock_t ourClock = currClock->getClock(thread);
+		unsigned int threadid = id_to_int(thread);
+		if (!(mask & ~oldmask) && WRTHREADID(cell->write) == threadid &&
+				WRITEVECTOR(cell->write) == ourClock && (atomic || !ISATOMICWRITE(cell->write))) {
+			/* Reading our own write from the same step: anything
+			 * racing with this read also races with that write
+			 * (unless only the write is atomic) */
+			RACESTAT(shortchecks);
+			return;
+		}
+		if (oldmask == mask || oldmask == 0) {
+			if (cell->read == 0 || ISREADEPOCH(cell->read))
+				RACESTAT(shortchecks);
+			else
+				RACESTAT(fullchecks);
+			cellRaceCheckRead(thread, (void *)(word + __builtin_ctz(mask)), cell, mask, currClock, atomic);
+			return;
+		}
+		if (ISREADEPOCH(cell->read) && !ISATOMICREAD(cell->read) == !atomic &&
+				RDTHREADID(cell->read) == threadid &&
+				READVECTOR(cell->read) == ourClock && cell->readsite == accesssite &&
+				(!(mask & ~oldmask) || WRITEVECTOR(cell->write) == 0)) {
+			/* This read was already checked and recorded for the
+			 * bytes covered, and new bytes would get the same
+			 * history: widen the mask */
+			RACESTAT(shortchecks);
+			cell->write |= ((uint64_t)mask) << 1;
+			return;
+		}
+		splitCell(cell);
 	}
 
-	int threadid = id_to_int(thread);
-	modelclock_t ourClock = currClock->getClock(thread);
+	RACESTAT(fullchecks);
+	struct ShadowCell *bytes = SPLITCELLS(cell);
+	for (int i = 0; i < SHADOWWORD; i++)
+		if ((mask & (1 << i)) && !ISIGNOREDCELL(&bytes[i]))
+			cellRaceCheckRead(thread, (void *)(word + i), &bytes[i], 1 << i, currClock, atomic);
+}
 
-	/* Thread ID is too large or clock is too large. */
-	if (threadid > MAXTHREADID || ourClock > MAXWRITEVECTOR) {
-		expandRecord(shadow);
-		fullRaceCheckRead(thread, location, shadow, currClock);
+/**
+ * Does race detection on an access of size bytes (at most a few words),
+ * recording the access in the shadow cells.
+ * @param atomic Whether this is an atomic access; these are only checked
+ * against non-atomic accesses
+ */
+static inline void accessRaceCheck(thread_id_t thread, uintptr_t address, unsigned int size, bool isWrite, bool atomic)
+{
+	if (isSuppressedSite(accesssite))
 		return;
+
+	uint64_t start = raceStatsStart();
+	ClockVector *currClock = get_execution()->get_cv(thread);
+
+	ASSERT(id_to_int(thread) <= MAXTHREADID);
+	while (size > 0) {
+		unsigned int offset = address & WORDMASK;
+		unsigned int len = SHADOWWORD - offset < size ? SHADOWWORD - offset : size;
+		if (isWrite)
+			wordRaceCheckWrite(thread, address - offset, ((1 << len) - 1) << offset, currClock, atomic);
+		else
+			wordRaceCheckRead(thread, address - offset, ((1 << len) - 1) << offset, currClock, atomic);
+		address += len;
+		size -= len;
 	}
+	raceStatsStop(start);
+}
 
-	/* Check for datarace against last write. */
+/** This function does race detection on a write of size bytes. */
+void raceCheckWrite(thread_id_t thread, void *location, unsigned int size, const void *site)
+{
+	accesssite = site;
+	accessRaceCheck(thread, (uintptr_t)location, size, true, false);
+}
 
-	modelclock_t writeClock = WRITEVECTOR(shadowval);
-	thread_id_t writeThread = int_to_id(WRTHREADID(shadowval));
+/** This function does race detection on an atomic write of size bytes. */
+void raceCheckAtomicWrite(thread_id_t thread, void *location, unsigned int size, const void *site)
+{
+	accesssite = site;
+	accessRaceCheck(thread, (uintptr_t)location, size, true, true);
+}
 
-	if (clock_may_race(currClock, thread, writeClock, writeThread)) {
-		/* We have a datarace */
-		reportDataRace(writeThread, writeClock, true, get_execution()->get_parent_action(thread), false, location);
-	}
+/** This function does race detection on a read of size bytes. */
+void raceCheckRead(thread_id_t thread, const void *location, unsigned int size, const void *site)
+{
+	accesssite = site;
+	accessRaceCheck(thread, (uintptr_t)location, size, false, false);
+}
 
-	modelclock_t readClock = READVECTOR(shadowval);
-	thread_id_t readThread = int_to_id(RDTHREADID(shadowval));
+/** This function does race detection on an atomic read of size bytes. */
+void raceCheckAtomicRead(thread_id_t thread, const void *location, unsigned int size, const void *site)
+{
+	accesssite = site;
+	accessRaceCheck(thread, (uintptr_t)location, size, false, true);
+}
 
-	if (clock_may_race(currClock, thread, readClock, readThread)) {
-		/* We don't subsume this read... Have to expand record. */
-		expandRecord(shadow);
-		fullRaceCheckRead(thread, location, shadow, currClock);
+/** @return Whether a cell's state is held entirely inline (not split into
+ * bytes and with no read vector), so it can be compared and copied by value */
+static bool isInlineCell(const struct ShadowCell *cell)
+{
+	return !ISSPLITCELL(cell) && (cell->read == 0 || ISREADEPOCH(cell->read));
+}
+
+/**
+ * Does race detection on an access to the size bytes at address in a single
+ * pass over the shadow cells. The new state of a fully covered word depends
+ * only on its old state, so when a word's cell is inline and identical to the
+ * previous word's old cell, the previous word's new cell is copied over
+ * without repeating the checks (and without reporting the same race again).
+ * This makes runs of untouched or uniformly accessed memory cheap.
+ */
+static void rangeRaceCheck(thread_id_t thread, uintptr_t address, size_t size, bool isWrite, const void *site)
+{
+	ClockVector *currClock = get_execution()->get_cv(thread);
+	struct ShadowCell before = { 0, 0, NULL, NULL }, after = { 0, 0, NULL, NULL };
+	bool haverun = false;
+
+	accesssite = site;
+	if (isSuppressedSite(site))
 		return;
+	uint64_t start = raceStatsStart();
+	ASSERT(id_to_int(thread) <= MAXTHREADID);
+	while (size > 0) {
+		unsigned int offset = address & WORDMASK;
+		unsigned int len = SHADOWWORD - offset < size ? SHADOWWORD - offset : size;
+		unsigned int mask = ((1 << len) - 1) << offset;
+		struct ShadowCell *cell = lookupAddressEntry((void *)address);
+
+		if (haverun && mask == 0xff && cell->write == before.write && cell->read == before.read &&
+				cell->writesite == before.writesite && cell->readsite == before.readsite) {
+			RACESTAT(copiedwords);
+			*cell = after;
+		} else {
+			before = *cell;
+			if (isWrite)
+				wordRaceCheckWrite(thread, address - offset, mask, currClock, false);
+			else
+				wordRaceCheckRead(thread, address - offset, mask, currClock, false);
+			after = *cell;
+			haverun = mask == 0xff && isInlineCell(&before) && isInlineCell(&after);
+		}
+		address += len;
+		size -= len;
 	}
+	raceStatsStop(start);
+}
+
+/** This function does race detection on a write to a whole region. */
+void raceCheckWriteRange(thread_id_t thread, void *location, size_t size, const void *site)
+{
+	rangeRaceCheck(thread, (uintptr_t)location, size, true, site);
+}
 
-	*shadow = ENCODEOP(threadid, ourClock, id_to_int(writeThread), writeClock);
+/** This function does race detection on a read of a whole region. */
+void raceCheckReadRange(thread_id_t thread, const void *location, size_t size, const void *site)
+{
+	rangeRaceCheck(thread, (uintptr_t)location, size, false, site);
 }
 
 bool haveUnrealizedRaces()
 {
 	return !unrealizedraces->empty();
 }
+
+/**
+ * @brief Print every distinct race realized during the run
+ *
+ * The access sites are only symbolized here, once, at the end of
+ * model-checking.
+ */
+void printRaceReports()
+{
+	unsigned int num = racereportlist->size();
+	if (num == 0)
+		return;
+
+	void **sites = (void **)model_malloc(2 * num * sizeof(void *));
+	for (unsigned int i = 0; i < num; i++) {
+		sites[2 * i] = (void *)(*racereportlist)[i]->oldsite;
+		sites[2 * i + 1] = (void *)(*racereportlist)[i]->newsite;
+	}
+	char **symbols = backtrace_symbols(sites, 2 * num);
+
+	model_print("Data races detected: %u\n", num);
+	for (unsigned int i = 0; i < num; i++) {
+		struct RaceReport *report = (*racereportlist)[i];
+		model_print("  Race %u @ address %p (realized %u time%s):\n", i + 1, report->address, report->count,
+				report->count > 1 ? "s" : "");
+		model_print("    Access 1: %5s at %s\n", accessName(report->isoldwrite, report->isoldatomic),
+				report->oldsite && symbols ? symbols[2 * i] : "(unknown)");
+		model_print("    Access 2: %5s at %s\n", accessName(report->isnewwrite, report->isnewatomic),
+				report->newsite && symbols ? symbols[2 * i + 1] : "(unknown)");
+	}
+	free(symbols);
+	model_free(sites);
+}
@@ -7,19 +7,12 @@
 
 #include "config.h"
 #include <stdint.h>
+#include <stddef.h>
 #include "modeltypes.h"
 
 /* Forward declaration */
 class ModelAction;
 
-struct ShadowTable {
-	void * array[65536];
-};
-
-struct ShadowBaseTable {
-	uint64_t array[65536];
-};
-
 struct DataRace {
 	/* Clock and thread associated with first action.  This won't change in
 		 response to synchronization. */
@@ -37,58 +30,137 @@ struct DataRace {
 
 	/* Address of data race. */
 	const void *address;
+
+	/* Record whether the accesses are atomic (a race needs at least one
+		 non-atomic access). */
+	bool isoldatomic;
+	bool isnewatomic;
+
+	/* Call sites of the two accesses (NULL if unknown). */
+	const void *oldsite;
+	const void *newsite;
 };
 
-#define MASK16BIT 0xffff
+#if BIT48
+#define ADDRESSBITS 48
+#else
+#define ADDRESSBITS 32
+#endif
+
+#define SHADOWREGIONSIZE (((uintptr_t)1) << SHADOWREGIONBITS)
+#define NUMSHADOWREGIONS (1 << (ADDRESSBITS - SHADOWREGIONBITS))
 
 void initRaceDetector();
-void raceCheckWrite(thread_id_t thread, void *location);
-void raceCheckRead(thread_id_t thread, const void *location);
+void resetRaceDetector();
+void raceCheckWrite(thread_id_t thread, void *location, unsigned int size = 1, const void *site = NULL);
+void raceCheckRead(thread_id_t thread, const void *location, unsigned int size = 1, const void *site = NULL);
+void raceCheckWriteRange(thread_id_t thread, void *location, size_t size, const void *site = NULL);
+void raceCheckReadRange(thread_id_t thread, const void *location, size_t size, const void *site = NULL);
+void raceCheckAtomicWrite(thread_id_t thread, void *location, unsigned int size, const void *site = NULL);
+void raceCheckAtomicRead(thread_id_t thread, const void *location, unsigned int size, const void *site = NULL);
 bool checkDataRaces();
 void assert_race(struct DataRace *race);
 bool haveUnrealizedRaces();
+void printRaceReports();
+void loadRaceSuppressions(const char *filename);
+void enableRaceStats();
+void printRaceStats();
 
 /**
- * @brief A record of information for detecting data races
+ * @brief The race detector's shadow state for one 8-byte word of memory
+ *
+ * Following FastTrack, the last write is kept as an epoch (a thread and its
+ * clock), and so are the reads since that write, as long as they are totally
+ * ordered by happens-before. Only concurrent reads need a ReadVector, and the
+ * next write drops it again.
+ *
+ * A cell normally describes all of the accessed bytes of its word (the bytes
+ * in its mask). Once those bytes' histories differ, the cell instead points
+ * to one cell per byte; see ISSPLITCELL().
+ *
+ * Atomic accesses (from cmodelint) are recorded in the same epochs, with a
+ * flag bit, so that atomic and non-atomic accesses to one location are
+ * checked against each other; two atomic accesses never race. As a result,
+ * an atomic write cannot subsume the atomic accesses it does not happen
+ * after: they are kept with the reads (an earlier atomic write as an epoch
+ * flagged with WRITEENTRY), for the later non-atomic accesses to check.
+ *
+ * Each epoch is stored with the call site of its access, so a race report
+ * names the exact code of both accesses.
  */
-struct RaceRecord {
-	modelclock_t *readClock;
-	thread_id_t *thread;
-	int capacity;
+struct ShadowCell {
+	/** @brief The byte mask and last write epoch; see ENCODEWRITE() */
+	uint64_t write;
+	/** @brief 0, a read epoch (see ENCODEREAD()), or a ReadVector pointer */
+	uint64_t read;
+	/** @brief The call site of the last write (NULL if unknown) */
+	const void *writesite;
+	/** @brief The call site of the read epoch, if read is one */
+	const void *readsite;
+};
+
+/** @brief A read epoch kept in a ReadVector, with its call site */
+struct ReadEntry {
+	uint64_t epoch;
+	const void *site;
+};
+
+/** @brief The concurrent reads recorded for a ShadowCell */
+struct ReadVector {
 	int numReads;
-	thread_id_t writeThread;
-	modelclock_t writeClock;
+	int capacity;
+	/** @brief Read epochs; allocated inline, with room for capacity */
+	struct ReadEntry reads[1];
 };
 
 #define INITCAPACITY 4
 
-#define ISSHORTRECORD(x) ((x)&0x1)
+#define SHADOWWORD 8
+#define WORDMASK (SHADOWWORD - 1)
 
-#define THREADMASK 0xff
-#define RDTHREADID(x) (((x)>>1)&THREADMASK)
-#define READMASK 0x07fffff
-#define READVECTOR(x) (((x)>>9)&READMASK)
+#define ISSPLITCELL(cell) ((cell)->write & 0x1)
+/** @brief The write field of a cell for suppressed memory; never a real epoch */
+#define IGNOREDCELL (1ULL<<58)
+#define ISIGNOREDCELL(cell) ((cell)->write == IGNOREDCELL)
+#define SPLITCELLS(cell) ((struct ShadowCell *)((cell)->write & ~0x1ULL))
+#define ENCODESPLIT(cells) (((uint64_t)(cells)) | 0x1)
 
-#define WRTHREADID(x) (((x)>>32)&THREADMASK)
+#define THREADMASK 0xffff
 
-#define WRITEMASK READMASK
-#define WRITEVECTOR(x) (((x)>>40)&WRITEMASK)
+/**
+ * A cell's write field is encoded as follows:
+ *  - lowest bit clear (set for split cells)
+ *  - next 8 bits are the mask of bytes the cell covers
+ *  - next 16 bits are the write thread id
+ *  - next 32 bits are the write clock
+ *  - next bit is set if the write was atomic
+ */
+#define ENCODEWRITE(mask, wrthread, wrtime) ((((uint64_t)mask)<<1) | (((uint64_t)wrthread)<<9) | (((uint64_t)wrtime)<<25))
+#define BYTEMASK(x) (((x)>>1)&0xff)
+#define WRTHREADID(x) (((x)>>9)&THREADMASK)
+#define WRITEVECTOR(x) ((modelclock_t)(((x)>>25)&0xffffffff))
+#define ATOMICWRITE (1ULL<<57)
+#define ISATOMICWRITE(x) ((x)&ATOMICWRITE)
 
 /**
- * The basic encoding idea is that (void *) either:
- *  -# points to a full record (RaceRecord) or
- *  -# encodes the information in a 64 bit word. Encoding is as
- *     follows:
- *     - lowest bit set to 1
- *     - next 8 bits are read thread id
- *     - next 23 bits are read clock vector
- *     - next 8 bits are write thread id
- *     - next 23 bits are write clock vector
+ * A read epoch is encoded as follows (a ReadVector pointer has the lowest
+ * bit clear):
+ *  - lowest bit set
+ *  - next 16 bits are the read thread id
+ *  - next 32 bits are the read clock
+ *  - next bit is set if the read was atomic
+ *  - next bit is set if the access was in fact an atomic write (see
+ *    ShadowCell)
  */
-#define ENCODEOP(rdthread, rdtime, wrthread, wrtime) (0x1ULL | ((rdthread)<<1) | ((rdtime) << 9) | (((uint64_t)wrthread)<<32) | (((uint64_t)wrtime)<<40))
+#define ENCODEREAD(rdthread, rdtime) (0x1ULL | (((uint64_t)rdthread)<<1) | (((uint64_t)rdtime)<<17))
+#define ISREADEPOCH(x) ((x)&0x1)
+#define RDTHREADID(x) (((x)>>1)&THREADMASK)
+#define READVECTOR(x) ((modelclock_t)(((x)>>17)&0xffffffff))
+#define ATOMICREAD (1ULL<<49)
+#define ISATOMICREAD(x) ((x)&ATOMICREAD)
+#define WRITEENTRY (1ULL<<50)
+#define ISWRITEENTRY(x) ((x)&WRITEENTRY)
 
-#define MAXTHREADID (THREADMASK-1)
-#define MAXREADVECTOR (READMASK-1)
-#define MAXWRITEVECTOR (WRITEMASK-1)
+#define MAXTHREADID THREADMASK
 
 #endif /* __DATARACE_H__ */
@@ -27,6 +27,7 @@ struct model_snapshot_members {
 		/* First thread created will have id INITIAL_THREAD_ID */
 		next_thread_id(INITIAL_THREAD_ID),
 		used_sequence_numbers(0),
+		used_loc_ids(0),
 		next_backtrack(NULL),
 		bugs(),
 		failed_promise(false),
@@ -44,6 +45,7 @@ struct model_snapshot_members {
 
 	unsigned int next_thread_id;
 	modelclock_t used_sequence_numbers;
+	unsigned int used_loc_ids;
 	ModelAction *next_backtrack;
 	SnapVector<bug_message *> bugs;
 	bool failed_promise;
@@ -66,6 +68,7 @@ ModelExecution::ModelExecution(ModelChecker *m,
 	scheduler(scheduler),
 	action_trace(),
 	thread_map(2), /* We'll always need at least 2 threads */
+	loc_ids(),
 	obj_map(),
 	condvar_waiters_map(),
 	obj_thrd_map(),
@@ -74,6 +77,8 @@ ModelExecution::ModelExecution(ModelChecker *m,
 	pending_rel_seqs(),
 	thrd_last_action(1),
 	thrd_last_fence_release(),
+	thrd_first_step(),
+	thrd_spin_state(),
 	node_stack(node_stack),
 	priv(new struct model_snapshot_members()),
 	mo_graph(new CycleGraph())
@@ -103,29 +108,55 @@ int ModelExecution::get_execution_number() const
 	return model->get_execution_number();
 }
 
-static action_list_t * get_safe_ptr_action(HashTable<const void *, action_list_t *, uintptr_t, 4> * hash, void * ptr)
+/**
+ * @brief Get the entry for a location ID from a per-location table
+ * @return The entry, if present; otherwise NULL
+ */
+template <typename T>
+static T * get_ptr(const SnapVector<T *> *vec, unsigned int loc_id)
+{
+	return loc_id < vec->size() ? (*vec)[loc_id] : NULL;
+}
+
+/**
+ * @brief Get the entry for a location ID from a per-location table, creating
+ * it if it doesn't exist yet
+ */
+template <typename T>
+static T * get_safe_ptr(SnapVector<T *> *vec, unsigned int loc_id)
 {
-	action_list_t *tmp = hash->get(ptr);
+	if (loc_id >= vec->size())
+		vec->resize(loc_id + 1);
+	T *tmp = (*vec)[loc_id];
 	if (tmp == NULL) {
-		tmp = new action_list_t();
-		hash->put(ptr, tmp);
+		tmp = new T();
+		(*vec)[loc_id] = tmp;
 	}
 	return tmp;
 }
 
-static SnapVector<action_list_t> * get_safe_ptr_vect_action(HashTable<void *, SnapVector<action_list_t> *, uintptr_t, 4> * hash, void * ptr)
+/**
+ * @brief Get the dense ID for a memory location, assigning one on its first
+ * touch in this execution
+ *
+ * Location IDs index the per-location tables (obj_map, obj_thrd_map, ...),
+ * so the location only needs to be hashed once per action.
+ * @param location The memory location
+ * @return The location's ID; IDs are numbered from 1
+ */
+unsigned int ModelExecution::get_loc_id(const void *location)
 {
-	SnapVector<action_list_t> *tmp = hash->get(ptr);
-	if (tmp == NULL) {
-		tmp = new SnapVector<action_list_t>();
-		hash->put(ptr, tmp);
+	unsigned int id = loc_ids.get(location);
+	if (!id) {
+		id = ++priv->used_loc_ids;
+		loc_ids.put(location, id);
 	}
-	return tmp;
+	return id;
 }
 
 action_list_t * ModelExecution::get_actions_on_obj(void * obj, thread_id_t tid) const
 {
-	SnapVector<action_list_t> *wrv = obj_thrd_map.get(obj);
+	SnapVector<action_list_t> *wrv = get_ptr(&obj_thrd_map, loc_ids.get(obj));
 	if (wrv==NULL)
 		return NULL;
 	unsigned int thread=id_to_int(tid);
@@ -193,6 +224,141 @@ void ModelExecution::wake_up_sleeping_actions(ModelAction *curr)
 	}
 }
 
+/**
+ * @brief Check if a thread is caught in a spin loop
+ * @param tid The thread
+ * @return True if the thread has repeated a read with no side effect since,
+ * and no write has woken it up
+ */
+bool ModelExecution::is_spinning(thread_id_t tid) const
+{
+	unsigned int i = id_to_int(tid);
+	return i < thrd_spin_state.size() && thrd_spin_state[i].spinning;
+}
+
+/**
+ * @brief Update the spin-loop detection state for a thread's action
+ *
+ * A thread is spinning when the whole sequence of reads it made since its
+ * last side effect (write, RMW, fence, mutex or thread operation) is one
+ * iteration repeated twice: the same call sites and locations, in the same
+ * order, reading from the same stores. The second iteration changed nothing,
+ * so the thread is blocked before its next read (see check_action_enabled())
+ * until another thread writes a location it has read; any other value the
+ * reads could have seen is still explored by backtracking on the reads
+ * themselves.
+ *
+ * Non-atomic accesses are not visible to the model checker, so a loop whose
+ * only side effects are on non-atomics (or a loop with a fixed trip count)
+ * can be taken for a spin loop too. Blocking it only delays it: once no other
+ * thread can run, the spinning threads are woken up again (see
+ * wake_up_spin_blocked_threads()).
+ *
+ * @param curr The action that was just taken
+ */
+void ModelExecution::update_spin_state(ModelAction *curr)
+{
+	if (curr->is_write())
+		wake_up_spinning_threads(curr);
+
+	/* The first half of an RMW is handled with its second half; a yield
+	 * is no side effect */
+	if (curr->is_rmwr() || curr->is_yield())
+		return;
+
+	unsigned int i = id_to_int(curr->get_tid());
+	if (i >= thrd_spin_state.size())
+		thrd_spin_state.resize(get_num_threads());
+	struct spin_state *state = &thrd_spin_state[i];
+
+	/* Plain loads and failed compare-exchanges (see process_rmw()) */
+	const ModelAction *rf = curr->get_reads_from();
+	if (curr->get_type() != ATOMIC_READ || !rf || !curr->get_site()) {
+		state->reads.clear();
+		state->spinning = false;
+		return;
+	}
+
+	for (unsigned int j = 0; j < state->reads.size(); j++) {
+		struct spin_read *read = &state->reads[j];
+		if (read->site == curr->get_site() && read->location == curr->get_location() && read->rf != rf) {
+			/* It has seen a change; start over from this read */
+			state->reads.clear();
+			break;
+		}
+	}
+	state->reads.push_back(spin_read(curr->get_site(), curr->get_location(), rf));
+
+	unsigned int half = state->reads.size() / 2;
+	if (state->reads.size() % 2 != 0)
+		return;
+	for (unsigned int j = 0; j < half; j++) {
+		const struct spin_read *read = &state->reads[j];
+		const struct spin_read *repeat = &state->reads[half + j];
+		if (read->site != repeat->site || read->location != repeat->location || read->rf != repeat->rf)
+			return;
+	}
+	state->spinning = true;
+}
+
+/**
+ * @brief Wake up the threads spinning on a location that was just written
+ *
+ * Threads that have merely read the location start their spin detection
+ * over, too.
+ *
+ * @param write The write (or RMW)
+ */
+void ModelExecution::wake_up_spinning_threads(const ModelAction *write)
+{
+	for (unsigned int i = 0; i < thrd_spin_state.size(); i++) {
+		struct spin_state *state = &thrd_spin_state[i];
+		if ((int)i == id_to_int(write->get_tid()) || state->reads.empty())
+			continue;
+
+		bool watched = false;
+		for (unsigned int j = 0; j < state->reads.size() && !watched; j++)
+			watched = state->reads[j].location == write->get_location();
+		if (!watched)
+			continue;
+
+		state->reads.clear();
+		if (state->spinning)
+			stop_spinning(int_to_id(i));
+	}
+}
+
+/**
+ * @brief Wake up the spinning threads if they are the only ones left to run
+ *
+ * Blocking a spinning thread only lets the other threads make progress first;
+ * if none of them can, the spinning threads run their loops on (bounded by
+ * -m or -b if they never end).
+ */
+void ModelExecution::wake_up_spin_blocked_threads()
+{
+	for (unsigned int i = 0; i < get_num_threads(); i++)
+		if (is_enabled(int_to_id(i)))
+			return;
+	for (unsigned int i = 0; i < thrd_spin_state.size(); i++) {
+		struct spin_state *state = &thrd_spin_state[i];
+		if (state->spinning) {
+			state->reads.clear();
+			stop_spinning(int_to_id(i));
+		}
+	}
+}
+
+/** @brief Clear a thread's spinning flag, and re-enable its blocked read */
+void ModelExecution::stop_spinning(thread_id_t tid)
+{
+	thrd_spin_state[id_to_int(tid)].spinning = false;
+	/* Its next read was disabled by check_action_enabled() */
+	Thread *t = get_thread(tid);
+	if (!is_enabled(t) && t->get_pending() && t->get_pending()->is_read())
+		scheduler->wake(t);
+}
+
 /** @brief Alert the model-checker that an incorrectly-ordered
  * synchronization was made */
 void ModelExecution::set_bad_synchronization()
@@ -286,6 +452,23 @@ bool ModelExecution::is_yieldblocked() const
 	return false;
 }
 
+/**
+ * @brief Check if a thread is still blocked in a spin loop
+ *
+ * Spin-blocked threads are woken up once no other thread can run (see
+ * wake_up_spin_blocked_threads()), so this only happens when the execution
+ * was cut short, e.g., by the -b bound.
+ *
+ * @return True if some thread is spin-blocked; false otherwise
+ */
+bool ModelExecution::is_spinblocked() const
+{
+	for (unsigned int i = 0; i < thrd_spin_state.size(); i++)
+		if (thrd_spin_state[i].spinning && !is_enabled(int_to_id(i)))
+			return true;
+	return false;
+}
+
 /**
  * Check if this is a complete execution. That is, have all thread completed
  * execution (rather than exiting because sleep sets have forced a redundant
@@ -295,7 +478,7 @@ bool ModelExecution::is_yieldblocked() const
  */
 bool ModelExecution::is_complete_execution() const
 {
-	if (is_yieldblocked())
+	if (is_yieldblocked() || is_spinblocked())
 		return false;
 	for (unsigned int i = 0; i < get_num_threads(); i++)
 		if (is_enabled(int_to_id(i)))
@@ -400,7 +583,7 @@ ModelAction * ModelExecution::get_last_conflict(ModelAction *act) const
 		ModelAction *ret = NULL;
 
 		/* linear search: from most recent to oldest */
-		action_list_t *list = obj_map.get(act->get_location());
+		action_list_t *list = get_ptr(&obj_map, act->get_loc_id());
 		action_list_t::reverse_iterator rit;
 		for (rit = list->rbegin(); rit != list->rend(); rit++) {
 			ModelAction *prev = *rit;
@@ -424,7 +607,7 @@ ModelAction * ModelExecution::get_last_conflict(ModelAction *act) const
 	case ATOMIC_LOCK:
 	case ATOMIC_TRYLOCK: {
 		/* linear search: from most recent to oldest */
-		action_list_t *list = obj_map.get(act->get_location());
+		action_list_t *list = get_ptr(&obj_map, act->get_loc_id());
 		action_list_t::reverse_iterator rit;
 		for (rit = list->rbegin(); rit != list->rend(); rit++) {
 			ModelAction *prev = *rit;
@@ -435,7 +618,7 @@ ModelAction * ModelExecution::get_last_conflict(ModelAction *act) const
 	}
 	case ATOMIC_UNLOCK: {
 		/* linear search: from most recent to oldest */
-		action_list_t *list = obj_map.get(act->get_location());
+		action_list_t *list = get_ptr(&obj_map, act->get_loc_id());
 		action_list_t::reverse_iterator rit;
 		for (rit = list->rbegin(); rit != list->rend(); rit++) {
 			ModelAction *prev = *rit;
@@ -446,7 +629,7 @@ ModelAction * ModelExecution::get_last_conflict(ModelAction *act) const
 	}
 	case ATOMIC_WAIT: {
 		/* linear search: from most recent to oldest */
-		action_list_t *list = obj_map.get(act->get_location());
+		action_list_t *list = get_ptr(&obj_map, act->get_loc_id());
 		action_list_t::reverse_iterator rit;
 		for (rit = list->rbegin(); rit != list->rend(); rit++) {
 			ModelAction *prev = *rit;
@@ -461,7 +644,7 @@ ModelAction * ModelExecution::get_last_conflict(ModelAction *act) const
 	case ATOMIC_NOTIFY_ALL:
 	case ATOMIC_NOTIFY_ONE: {
 		/* linear search: from most recent to oldest */
-		action_list_t *list = obj_map.get(act->get_location());
+		action_list_t *list = get_ptr(&obj_map, act->get_loc_id());
 		action_list_t::reverse_iterator rit;
 		for (rit = list->rbegin(); rit != list->rend(); rit++) {
 			ModelAction *prev = *rit;
@@ -500,49 +683,31 @@ void ModelExecution::set_backtracking(ModelAction *act)
 		high_tid = get_num_threads();
 	}
 
-	for (int i = low_tid; i < high_tid; i++) {
+	/* See Dynamic Partial Order Reduction (addendum), POPL '05 */
+	/* Only backtrack into threads that are enabled (not disabled or
+	 * sleeping) here, and that have not been explored already */
+	for (int i = node->get_next_unexplored(low_tid);
+			i >= 0 && i < high_tid;
+			i = node->get_next_unexplored(i + 1)) {
 		thread_id_t tid = int_to_id(i);
 
-		/* Make sure this thread can be enabled here. */
-		if (i >= node->get_num_threads())
-			break;
-
-		/* See Dynamic Partial Order Reduction (addendum), POPL '05 */
-		/* Don't backtrack into a point where the thread is disabled or sleeping. */
-		if (node->enabled_status(tid) != THREAD_ENABLED)
-			continue;
-
-		/* Check if this has been explored already */
-		if (node->has_been_explored(tid))
-			continue;
-
-		/* See if fairness allows */
-		if (params->fairwindow != 0 && !node->has_priority(tid)) {
-			bool unfair = false;
-			for (int t = 0; t < node->get_num_threads(); t++) {
-				thread_id_t tother = int_to_id(t);
-				if (node->is_enabled(tother) && node->has_priority(tother)) {
-					unfair = true;
-					break;
-				}
-			}
-			if (unfair)
+		/* Let an interchangeable thread stand in for it */
+		if (params->symmetry) {
+			tid = get_symmetric_thread(node, tid, prev);
+			if (node->enabled_status(tid) != THREAD_ENABLED ||
+					node->has_been_explored(tid))
 				continue;
 		}
 
+		/* See if fairness allows */
+		if (params->fairwindow != 0 && !node->has_priority(tid) &&
+				node->has_priority_among(node->get_enabled_set()))
+			continue;
+
 		/* See if CHESS-like yield fairness allows */
-		if (params->yieldon) {
-			bool unfair = false;
-			for (int t = 0; t < node->get_num_threads(); t++) {
-				thread_id_t tother = int_to_id(t);
-				if (node->is_enabled(tother) && node->has_priority_over(tid, tother)) {
-					unfair = true;
-					break;
-				}
-			}
-			if (unfair)
-				continue;
-		}
+		if (params->yieldon &&
+				node->has_priority_over_any(tid, node->get_enabled_set()))
+			continue;
 
 		/* Cache the latest backtracking point */
 		set_latest_backtrack(prev);
@@ -560,6 +725,77 @@ void ModelExecution::set_backtracking(ModelAction *act)
 	}
 }
 
+/**
+ * @brief Put a newly-created symmetric thread in its symmetry class
+ *
+ * It joins the class of the thread its parent created last, if that one was
+ * also created symmetric, with the same start routine, and the parent did
+ * nothing but create threads since. Otherwise it starts a new class.
+ *
+ * @param th The new thread
+ * @param create The THREAD_CREATE action that created it
+ */
+void ModelExecution::set_symmetry_class(Thread *th, const ModelAction *create)
+{
+	th->set_symmetry_class(th->get_id());
+
+	Thread *parent = get_thread(create);
+	Thread *sibling = NULL;
+	for (int i = id_to_int(th->get_id()) - 1; i >= 0 && !sibling; i--)
+		if (get_thread(int_to_id(i))->get_parent() == parent)
+			sibling = get_thread(int_to_id(i));
+	if (!sibling || sibling->get_symmetry_class() == THREAD_ID_T_NONE ||
+			sibling->get_start_routine() != th->get_start_routine())
+		return;
+
+	action_list_t::reverse_iterator rit;
+	for (rit = action_trace.rbegin(); *rit != sibling->get_creation(); rit++) {
+		const ModelAction *act = *rit;
+		if (act->get_tid() == parent->get_id() && act->get_type() != THREAD_CREATE)
+			return;
+	}
+	th->set_symmetry_class(sibling->get_symmetry_class());
+}
+
+/**
+ * @return True if a thread took a step (other than starting) before a given
+ * action, in this execution
+ */
+bool ModelExecution::has_run_before(thread_id_t tid, const ModelAction *act) const
+{
+	unsigned int i = id_to_int(tid);
+	return i < thrd_first_step.size() && thrd_first_step[i] &&
+		*thrd_first_step[i] < *act;
+}
+
+/**
+ * @brief Find the thread to backtrack into in place of another, under
+ * symmetry reduction
+ *
+ * Two threads of a symmetry class that have yet to take a step are in the
+ * same state, so exploring either one first gives the same executions, up to
+ * swapping the threads. The one with the lowest ID stands in for the rest.
+ *
+ * @param node The Node to backtrack at
+ * @param tid The thread to backtrack into
+ * @param act The action to reorder it before
+ * @return The thread to backtrack into instead (possibly tid)
+ */
+thread_id_t ModelExecution::get_symmetric_thread(const Node *node, thread_id_t tid, const ModelAction *act) const
+{
+	thread_id_t symclass = get_thread(tid)->get_symmetry_class();
+	if (symclass == THREAD_ID_T_NONE || has_run_before(tid, act))
+		return tid;
+	for (int i = id_to_int(symclass); i < id_to_int(tid); i++) {
+		thread_id_t other = int_to_id(i);
+		if (get_thread(other)->get_symmetry_class() == symclass &&
+				node->enabled_status(other) != THREAD_DISABLED &&
+				!has_run_before(other, act))
+			return other;
+	}
+	return tid;
+}
+
 /**
  * @brief Cache the a backtracking point as the "most recent", if eligible
  *
@@ -721,14 +957,14 @@ bool ModelExecution::process_mutex(ModelAction *curr)
 
 		/* Should we go to sleep? (simulate spurious failures) */
 		if (curr->get_node()->get_misc() == 0) {
-			get_safe_ptr_action(&condvar_waiters_map, curr->get_location())->push_back(curr);
+			get_safe_ptr(&condvar_waiters_map, curr->get_loc_id())->push_back(curr);
 			/* disable us */
 			scheduler->sleep(get_thread(curr));
 		}
 		break;
 	}
 	case ATOMIC_NOTIFY_ALL: {
-		action_list_t *waiters = get_safe_ptr_action(&condvar_waiters_map, curr->get_location());
+		action_list_t *waiters = get_safe_ptr(&condvar_waiters_map, curr->get_loc_id());
 		//activate all the waiting threads
 		for (action_list_t::iterator rit = waiters->begin(); rit != waiters->end(); rit++) {
 			scheduler->wake(get_thread(*rit));
@@ -737,7 +973,7 @@ bool ModelExecution::process_mutex(ModelAction *curr)
 		break;
 	}
 	case ATOMIC_NOTIFY_ONE: {
-		action_list_t *waiters = get_safe_ptr_action(&condvar_waiters_map, curr->get_location());
+		action_list_t *waiters = get_safe_ptr(&condvar_waiters_map, curr->get_loc_id());
 		int wakeupthread = curr->get_node()->get_misc();
 		action_list_t::iterator it = waiters->begin();
 		advance(it, wakeupthread);
@@ -938,6 +1174,8 @@ bool ModelExecution::process_thread_action(ModelAction *curr)
 		Thread *th = new Thread(get_next_id(), thrd, params->func, params->arg, get_thread(curr));
 		add_thread(th);
 		th->set_creation(curr);
+		if (this->params->symmetry && params->symmetric)
+			set_symmetry_class(th, curr);
 		/* Promises can be satisfied by children */
 		for (unsigned int i = 0; i < promises.size(); i++) {
 			Promise *promise = promises[i];
@@ -1067,7 +1305,7 @@ bool ModelExecution::initialize_curr_action(ModelAction **curr)
 
 	(*curr)->set_seq_number(get_next_seq_num());
 
-	newcurr = node_stack->explore_action(*curr, scheduler->get_enabled_array());
+	newcurr = node_stack->explore_action(*curr, scheduler);
 	if (newcurr) {
 		/* First restore type and order in case of RMW operation */
 		if ((*curr)->is_rmwr())
@@ -1104,7 +1342,7 @@ bool ModelExecution::initialize_curr_action(ModelAction **curr)
 		else if (newcurr->is_wait())
 			newcurr->get_node()->set_misc_max(2);
 		else if (newcurr->is_notify_one()) {
-			newcurr->get_node()->set_misc_max(get_safe_ptr_action(&condvar_waiters_map, newcurr->get_location())->size());
+			newcurr->get_node()->set_misc_max(get_safe_ptr(&condvar_waiters_map, newcurr->get_loc_id())->size());
 		}
 		return true; /* This was a new ModelAction */
 	}
@@ -1196,7 +1434,8 @@ void ModelExecution::thread_blocking_check_promises(Thread *blocker, Thread *wai
  * Checks whether an operation would be successful (i.e., is a lock already
  * locked, or is the joined thread already complete).
  *
- * For yield-blocking, yields are never enabled.
+ * For yield-blocking, yields are never enabled. For spin-blocking, a
+ * spinning thread's reads are not enabled.
  *
  * @param curr is the ModelAction to check whether it is enabled.
  * @return a bool that indicates whether the action is enabled.
@@ -1215,6 +1454,8 @@ bool ModelExecution::check_action_enabled(ModelAction *curr) {
 		}
 	} else if (params->yieldblock && curr->is_yield()) {
 		return false;
+	} else if (params->spinblock && curr->is_read() && is_spinning(curr->get_tid())) {
+		return false;
 	}
 
 	return true;
@@ -1234,6 +1475,7 @@ bool ModelExecution::check_action_enabled(ModelAction *curr) {
 ModelAction * ModelExecution::check_current_action(ModelAction *curr)
 {
 	ASSERT(curr);
+	curr->set_loc_id(get_loc_id(curr->get_location()));
 	bool second_part_of_rmw = curr->is_rmwc() || curr->is_rmw();
 	bool newly_explored = initialize_curr_action(&curr);
 
@@ -1254,6 +1496,10 @@ ModelAction * ModelExecution::check_current_action(ModelAction *curr)
 	if (newly_explored && curr->is_read())
 		build_may_read_from(curr);
 
+	/* Take the recorded choices, if replaying a choice sequence */
+	if (newly_explored)
+		node_stack->replay_choices(curr->get_node());
+
 	/* Initialize work_queue with the "current action" work */
 	work_queue_t work_queue(1, CheckCurrWorkEntry(curr));
 	while (!work_queue.empty() && !has_asserted()) {
@@ -1325,6 +1571,9 @@ ModelAction * ModelExecution::check_current_action(ModelAction *curr)
 		}
 	}
 
+	if (params->spinblock)
+		update_spin_state(curr);
+
 	check_curr_backtracking(curr);
 	set_backtracking(curr);
 	return curr;
@@ -1452,7 +1701,7 @@ bool ModelExecution::should_read_instead(const ModelAction *curr, const T *rf, c
 	if (!mo_graph->checkReachable(rf, other_rf))
 		return false;
 
-	SnapVector<action_list_t> *thrd_lists = obj_thrd_map.get(curr->get_location());
+	SnapVector<action_list_t> *thrd_lists = get_ptr(&obj_thrd_map, curr->get_loc_id());
 	action_list_t *list = &(*thrd_lists)[id_to_int(curr->get_tid())];
 	action_list_t::reverse_iterator rit = list->rbegin();
 	ASSERT((*rit) == curr);
@@ -1495,7 +1744,7 @@ bool ModelExecution::check_recency(ModelAction *curr, const T *rf) const
 			curr->get_node()->get_read_from_promise_size() <= 1)
 		return true;
 
-	SnapVector<action_list_t> *thrd_lists = obj_thrd_map.get(curr->get_location());
+	SnapVector<action_list_t> *thrd_lists = get_ptr(&obj_thrd_map, curr->get_loc_id());
 	int tid = id_to_int(curr->get_tid());
 	ASSERT(tid < (int)thrd_lists->size());
 	action_list_t *list = &(*thrd_lists)[tid];
@@ -1552,7 +1801,7 @@ bool ModelExecution::check_recency(ModelAction *curr, const T *rf) const
 template <typename rf_type>
 bool ModelExecution::r_modification_order(ModelAction *curr, const rf_type *rf)
 {
-	SnapVector<action_list_t> *thrd_lists = obj_thrd_map.get(curr->get_location());
+	SnapVector<action_list_t> *thrd_lists = get_ptr(&obj_thrd_map, curr->get_loc_id());
 	unsigned int i;
 	bool added = false;
 	ASSERT(curr->is_read());
@@ -1678,7 +1927,7 @@ bool ModelExecution::r_modification_order(ModelAction *curr, const rf_type *rf)
  */
 bool ModelExecution::w_modification_order(ModelAction *curr, ModelVector<ModelAction *> *send_fv)
 {
-	SnapVector<action_list_t> *thrd_lists = obj_thrd_map.get(curr->get_location());
+	SnapVector<action_list_t> *thrd_lists = get_ptr(&obj_thrd_map, curr->get_loc_id());
 	unsigned int i;
 	bool added = false;
 	ASSERT(curr->is_write());
@@ -1823,7 +2072,7 @@ bool ModelExecution::thin_air_constraint_may_allow(const ModelAction *writer, co
  */
 bool ModelExecution::mo_may_allow(const ModelAction *writer, const ModelAction *reader)
 {
-	SnapVector<action_list_t> *thrd_lists = obj_thrd_map.get(reader->get_location());
+	SnapVector<action_list_t> *thrd_lists = get_ptr(&obj_thrd_map, reader->get_loc_id());
 	unsigned int i;
 	/* Iterate over all threads */
 	for (i = 0; i < thrd_lists->size(); i++) {
@@ -1924,7 +2173,7 @@ bool ModelExecution::release_seq_heads(const ModelAction *rf,
 		release_heads->push_back(fence_release);
 
 	int tid = id_to_int(rf->get_tid());
-	SnapVector<action_list_t> *thrd_lists = obj_thrd_map.get(rf->get_location());
+	SnapVector<action_list_t> *thrd_lists = get_ptr(&obj_thrd_map, rf->get_loc_id());
 	action_list_t *list = &(*thrd_lists)[tid];
 	action_list_t::const_reverse_iterator rit;
 
@@ -2149,7 +2398,7 @@ void ModelExecution::add_action_to_lists(ModelAction *act)
 	int tid = id_to_int(act->get_tid());
 	ModelAction *uninit = NULL;
 	int uninit_id = -1;
-	action_list_t *list = get_safe_ptr_action(&obj_map, act->get_location());
+	action_list_t *list = get_safe_ptr(&obj_map, act->get_loc_id());
 	if (list->empty() && act->is_atomic_var()) {
 		uninit = get_uninitialized_action(act);
 		uninit_id = id_to_int(uninit->get_tid());
@@ -2161,7 +2410,7 @@ void ModelExecution::add_action_to_lists(ModelAction *act)
 	if (uninit)
 		action_trace.push_front(uninit);
 
-	SnapVector<action_list_t> *vec = get_safe_ptr_vect_action(&obj_thrd_map, act->get_location());
+	SnapVector<action_list_t> *vec = get_safe_ptr(&obj_thrd_map, act->get_loc_id());
 	if (tid >= (int)vec->size())
 		vec->resize(priv->next_thread_id);
 	(*vec)[tid].push_back(act);
@@ -2174,6 +2423,13 @@ void ModelExecution::add_action_to_lists(ModelAction *act)
 	if (uninit)
 		thrd_last_action[uninit_id] = uninit;
 
+	if (params->symmetry && !act->is_thread_start()) {
+		if ((int)thrd_first_step.size() <= tid)
+			thrd_first_step.resize(get_num_threads());
+		if (!thrd_first_step[tid])
+			thrd_first_step[tid] = act;
+	}
+
 	if (act->is_fence() && act->is_release()) {
 		if ((int)thrd_last_fence_release.size() <= tid)
 			thrd_last_fence_release.resize(get_num_threads());
@@ -2181,10 +2437,10 @@ void ModelExecution::add_action_to_lists(ModelAction *act)
 	}
 
 	if (act->is_wait()) {
-		void *mutex_loc = (void *) act->get_value();
-		get_safe_ptr_action(&obj_map, mutex_loc)->push_back(act);
+		unsigned int mutex_id = get_loc_id((void *) act->get_value());
+		get_safe_ptr(&obj_map, mutex_id)->push_back(act);
 
-		SnapVector<action_list_t> *vec = get_safe_ptr_vect_action(&obj_thrd_map, mutex_loc);
+		SnapVector<action_list_t> *vec = get_safe_ptr(&obj_thrd_map, mutex_id);
 		if (tid >= (int)vec->size())
 			vec->resize(priv->next_thread_id);
 		(*vec)[tid].push_back(act);
@@ -2229,8 +2485,7 @@ ModelAction * ModelExecution::get_last_fence_release(thread_id_t tid) const
  */
 ModelAction * ModelExecution::get_last_seq_cst_write(ModelAction *curr) const
 {
-	void *location = curr->get_location();
-	action_list_t *list = obj_map.get(location);
+	action_list_t *list = get_ptr(&obj_map, curr->get_loc_id());
 	/* Find: max({i in dom(S) | seq_cst(t_i) && isWrite(t_i) && samevar(t_i, t)}) */
 	action_list_t::reverse_iterator rit;
 	for (rit = list->rbegin(); (*rit) != curr; rit++)
@@ -2253,7 +2508,7 @@ ModelAction * ModelExecution::get_last_seq_cst_write(ModelAction *curr) const
 ModelAction * ModelExecution::get_last_seq_cst_fence(thread_id_t tid, const ModelAction *before_fence) const
 {
 	/* All fences should have location FENCE_LOCATION */
-	action_list_t *list = obj_map.get(FENCE_LOCATION);
+	action_list_t *list = get_ptr(&obj_map, loc_ids.get(FENCE_LOCATION));
 
 	if (!list)
 		return NULL;
@@ -2285,8 +2540,7 @@ ModelAction * ModelExecution::get_last_seq_cst_fence(thread_id_t tid, const Mode
  */
 ModelAction * ModelExecution::get_last_unlock(ModelAction *curr) const
 {
-	void *location = curr->get_location();
-	action_list_t *list = obj_map.get(location);
+	action_list_t *list = get_ptr(&obj_map, curr->get_loc_id());
 	/* Find: max({i in dom(S) | isUnlock(t_i) && samevar(t_i, t)}) */
 	action_list_t::reverse_iterator rit;
 	for (rit = list->rbegin(); rit != list->rend(); rit++)
@@ -2373,6 +2627,9 @@ bool ModelExecution::resolve_promise(ModelAction *write, Promise *promise,
 		mo_check_promises(read, true);
 	}
 
+	/* See if resolving the promise has realized a data race */
+	checkDataRaces();
+
 	return true;
 }
 
@@ -2516,7 +2773,7 @@ void ModelExecution::compute_relseq_breakwrites(ModelAction *curr)
  */
 void ModelExecution::build_may_read_from(ModelAction *curr)
 {
-	SnapVector<action_list_t> *thrd_lists = obj_thrd_map.get(curr->get_location());
+	SnapVector<action_list_t> *thrd_lists = get_ptr(&obj_thrd_map, curr->get_loc_id());
 	unsigned int i;
 	ASSERT(curr->is_read());
 
@@ -2622,6 +2879,7 @@ ModelAction * ModelExecution::get_uninitialized_action(const ModelAction *curr)
 		act = new ModelAction(ATOMIC_UNINIT, std::memory_order_relaxed, curr->get_location(), params->uninitvalue, model_thread);
 		node->set_uninit_action(act);
 	}
+	act->set_loc_id(curr->get_loc_id());
 	act->create_cv(NULL);
 	return act;
 }
@@ -57,6 +57,29 @@ struct release_seq {
 	SnapVector<const ModelAction *> writes;
 };
 
+/** @brief A read in a thread's spin window; see
+ *  ModelExecution::update_spin_state() */
+struct spin_read {
+	spin_read(const void *site, const void *location, const ModelAction *rf) :
+		site(site), location(location), rf(rf)
+	{ }
+	const void *site;
+	const void *location;
+	/** @brief The store it read from */
+	const ModelAction *rf;
+};
+
+/** @brief A thread's spin-loop detection state (for params->spinblock) */
+struct spin_state {
+	spin_state() : reads(), spinning(false) { }
+	/** @brief The thread's reads since its last side effect (or since it
+	 *  last saw a read's value change), in order */
+	SnapVector<struct spin_read> reads;
+	/** @brief Those reads are one iteration repeated twice, so it may not
+	 *  read again until another thread writes one of their locations */
+	bool spinning;
+};
+
 /** @brief The central structure for model-checking */
 class ModelExecution {
 public:
@@ -110,7 +133,9 @@ public:
 	bool is_infeasible() const;
 	bool is_deadlocked() const;
 	bool is_yieldblocked() const;
+	bool is_spinblocked() const;
 	bool too_many_steps() const;
+	void wake_up_spin_blocked_threads();
 
 	ModelAction * get_next_backtrack();
 
@@ -135,7 +160,12 @@ private:
 	bool promises_expired() const;
 	bool should_wake_up(const ModelAction *curr, const Thread *thread) const;
 	void wake_up_sleeping_actions(ModelAction *curr);
+	bool is_spinning(thread_id_t tid) const;
+	void update_spin_state(ModelAction *curr);
+	void wake_up_spinning_threads(const ModelAction *write);
+	void stop_spinning(thread_id_t tid);
 	modelclock_t get_next_seq_num();
+	unsigned int get_loc_id(const void *location);
 
 	bool next_execution();
 	ModelAction * check_current_action(ModelAction *curr);
@@ -158,6 +188,9 @@ private:
 	ModelAction * get_last_fence_conflict(ModelAction *act) const;
 	ModelAction * get_last_conflict(ModelAction *act) const;
 	void set_backtracking(ModelAction *act);
+	void set_symmetry_class(Thread *th, const ModelAction *create);
+	bool has_run_before(thread_id_t tid, const ModelAction *act) const;
+	thread_id_t get_symmetric_thread(const Node *node, thread_id_t tid, const ModelAction *act) const;
 	bool set_latest_backtrack(ModelAction *act);
 	Promise * pop_promise_to_resolve(const ModelAction *curr);
 	bool resolve_promise(ModelAction *curr, Promise *promise,
@@ -193,15 +226,20 @@ private:
 	action_list_t action_trace;
 	SnapVector<Thread *> thread_map;
 
-	/** Per-object list of actions. Maps an object (i.e., memory location)
-	 * to a trace of all actions performed on the object. */
-	HashTable<const void *, action_list_t *, uintptr_t, 4> obj_map;
+	/** Maps an object (i.e., memory location) to its dense location ID;
+	 * see get_loc_id() */
+	HashTable<const void *, unsigned int, uintptr_t, 4> loc_ids;
 
-	/** Per-object list of actions. Maps an object (i.e., memory location)
-	 * to a trace of all actions performed on the object. */
-	HashTable<const void *, action_list_t *, uintptr_t, 4> condvar_waiters_map;
+	/** Per-object list of actions. Maps a location ID to a trace of all
+	 * actions performed on the object. */
+	SnapVector<action_list_t *> obj_map;
 
-	HashTable<void *, SnapVector<action_list_t> *, uintptr_t, 4> obj_thrd_map;
+	/** Per-object list of threads waiting on a condition variable, indexed
+	 * by location ID */
+	SnapVector<action_list_t *> condvar_waiters_map;
+
+	/** Per-object, per-thread lists of actions, indexed by location ID */
+	SnapVector<SnapVector<action_list_t> *> obj_thrd_map;
 
 	/**
 	 * @brief List of currently-pending promises
@@ -222,6 +260,12 @@ private:
 
 	SnapVector<ModelAction *> thrd_last_action;
 	SnapVector<ModelAction *> thrd_last_fence_release;
+	/** Each thread's first action after its THREAD_START, for symmetry
+	 * reduction */
+	SnapVector<ModelAction *> thrd_first_step;
+
+	/** Per-thread spin-loop detection state, indexed by thread ID */
+	SnapVector<struct spin_state> thrd_spin_state;
 	NodeStack * const node_stack;
 
 	/** A special model-checker Thread; used for associating with
@@ -1,5 +1,5 @@
 /** @file hashtable.h
- *  @brief Hashtable.  Standard chained bucket variety.
+ *  @brief Hashtable.  Open addressing with Robin Hood probing.
  */
 
 #ifndef __HASHTABLE_H__
@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include "mymemory.h"
 #include "common.h"
 
@@ -21,15 +22,34 @@ template<typename _Key, typename _Val>
 struct hashlistnode {
 	_Key key;
 	_Val val;
+	/**
+	 * @brief Slot metadata: (generation << HT_DIST_BITS) | probe distance
+	 *
+	 * The slot is empty unless its generation matches the table's.
+	 */
+	unsigned int meta;
 };
 
+/** @brief Number of low bits of hashlistnode::meta holding the probe distance */
+#define HT_DIST_BITS 8
+#define HT_MAX_DIST ((1 << HT_DIST_BITS) - 1)
+/** @brief Number of generations before the table must really be cleared */
+#define HT_MAX_GEN ((1U << (32 - HT_DIST_BITS)) - 1)
+
 /**
  * @brief A simple, custom hash table
  *
  * By default it is snapshotting, but you can pass in your own allocation
- * functions. Note that this table does not support the value 0 (NULL) used as
- * a key and is designed primarily with pointer-based keys in mind. Other
- * primitive key types are supported only for non-zero values.
+ * functions. It is designed primarily with pointer-based keys in mind, but
+ * other primitive key types are supported.
+ *
+ * This is an open-addressing table using Robin Hood probing: keys are hashed
+ * by Fibonacci (multiplicative) hashing, so keys with regular spacing (e.g.,
+ * pointers from the same allocator) don't cluster, and each entry stays as
+ * close to its home slot as any entry it passed over. That bounds probe
+ * lengths, lets lookups stop early, and allows deletion by shifting the
+ * following entries back, without tombstones. Each slot is tagged with a
+ * generation, so reset() only has to bump the table's generation.
  *
  * @tparam _Key    Type name for the key
  * @tparam _Val    Type name for the values to be stored
@@ -49,7 +69,7 @@ class HashTable {
 	/**
 	 * @brief Hash table constructor
 	 * @param initialcapacity Sets the initial capacity of the hash table.
-	 * Default size 1024.
+	 * Must be a power of 2. Default size 1024.
 	 * @param factor Sets the percentage full before the hashtable is
 	 * resized. Default ratio 0.5.
 	 */
@@ -57,10 +77,8 @@ class HashTable {
 		// Allocate space for the hash table
 		table = (struct hashlistnode<_Key, _Val> *)_calloc(initialcapacity, sizeof(struct hashlistnode<_Key, _Val>));
 		loadfactor = factor;
-		capacity = initialcapacity;
-		capacitymask = initialcapacity - 1;
-
-		threshold = (unsigned int)(initialcapacity * loadfactor);
+		set_capacity(initialcapacity);
+		generation = 1;
 		size = 0; // Initial number of elements in the hash
 	}
 
@@ -89,94 +107,125 @@ class HashTable {
 		_free(p);
 	}
 
-	/** @brief Reset the table to its initial state. */
+	/**
+	 * @brief Reset the table to its initial state.
+	 *
+	 * Invalidates all slots by moving to a new generation; the table
+	 * memory is only cleared once the generation counter wraps.
+	 */
 	void reset() {
-		memset(table, 0, capacity * sizeof(struct hashlistnode<_Key, _Val>));
+		if (++generation > HT_MAX_GEN) {
+			memset(table, 0, capacity * sizeof(struct hashlistnode<_Key, _Val>));
+			generation = 1;
+		}
 		size = 0;
 	}
 
 	/**
 	 * @brief Put a key/value pair into the table
-	 * @param key The key for the new value; must not be 0 or NULL
+	 * @param key The key for the new value
 	 * @param val The value to store in the table
 	 */
 	void put(_Key key, _Val val) {
-		/* HashTable cannot handle 0 as a key */
-		ASSERT(key);
-
-		if (size > threshold)
+		if (size >= threshold)
 			resize(capacity << 1);
 
 		struct hashlistnode<_Key, _Val> *search;
-
-		unsigned int index = ((_KeyInt)key) >> _Shift;
+		unsigned int index = hash(key);
+		unsigned int dist = 0;
 		do {
-			index &= capacitymask;
 			search = &table[index];
+			if (is_empty(search)) {
+				search->key = key;
+				search->val = val;
+				search->meta = make_meta(dist);
+				size++;
+				return;
+			}
 			if (search->key == key) {
 				search->val = val;
 				return;
 			}
-			index++;
-		} while (search->key);
+			/* Robin Hood: take the slot from a "richer" entry and
+			 * carry that one forward instead */
+			unsigned int searchdist = get_dist(search);
+			if (searchdist < dist) {
+				_Key tmpkey = search->key;
+				_Val tmpval = search->val;
+				search->key = key;
+				search->val = val;
+				search->meta = make_meta(dist);
+				key = tmpkey;
+				val = tmpval;
+				dist = searchdist;
+			}
+			index = (index + 1) & capacitymask;
+			dist++;
+		} while (dist < HT_MAX_DIST);
 
-		search->key = key;
-		search->val = val;
-		size++;
+		/* Pathological probe length: grow and re-insert what we carry */
+		resize(capacity << 1);
+		put(key, val);
 	}
 
 	/**
 	 * @brief Lookup the corresponding value for the given key
-	 * @param key The key for finding the value; must not be 0 or NULL
+	 * @param key The key for finding the value
 	 * @return The value in the table, if the key is found; otherwise 0
 	 */
 	_Val get(_Key key) const {
-		struct hashlistnode<_Key, _Val> *search;
-
-		/* HashTable cannot handle 0 as a key */
-		ASSERT(key);
-
-		unsigned int index = ((_KeyInt)key) >> _Shift;
-		do {
-			index &= capacitymask;
-			search = &table[index];
-			if (search->key == key)
-				return search->val;
-			index++;
-		} while (search->key);
-		return (_Val)0;
+		struct hashlistnode<_Key, _Val> *search = find(key);
+		return search ? search->val : (_Val)0;
 	}
 
 	/**
 	 * @brief Check whether the table contains a value for the given key
-	 * @param key The key for finding the value; must not be 0 or NULL
+	 * @param key The key for finding the value
 	 * @return True, if the key is found; false otherwise
 	 */
 	bool contains(_Key key) const {
-		struct hashlistnode<_Key, _Val> *search;
-
-		/* HashTable cannot handle 0 as a key */
-		ASSERT(key);
+		return find(key) != NULL;
+	}
 
-		unsigned int index = ((_KeyInt)key) >> _Shift;
-		do {
-			index &= capacitymask;
-			search = &table[index];
-			if (search->key == key)
-				return true;
+	/**
+	 * @brief Remove a key (and its value) from the table
+	 *
+	 * The entries following it in its probe run are shifted back one slot,
+	 * so no tombstone is left behind.
+	 * @param key The key to remove
+	 * @return The value that was stored for key, if any; otherwise 0
+	 */
+	_Val remove(_Key key) {
+		struct hashlistnode<_Key, _Val> *search = find(key);
+		if (!search)
+			return (_Val)0;
+		_Val val = search->val;
+
+		unsigned int index = search - table;
+		while (true) {
+			struct hashlistnode<_Key, _Val> *next = &table[(index + 1) & capacitymask];
+			if (is_empty(next) || get_dist(next) == 0)
+				break;
+			search->key = next->key;
+			search->val = next->val;
+			search->meta = make_meta(get_dist(next) - 1);
+			search = next;
 			index++;
-		} while (search->key);
-		return false;
+		}
+		search->meta = 0;
+		size--;
+		return val;
 	}
 
 	/**
 	 * @brief Resize the table
-	 * @param newsize The new size of the table
+	 * @param newsize The new size of the table; must be a power of 2
 	 */
 	void resize(unsigned int newsize) {
 		struct hashlistnode<_Key, _Val> *oldtable = table;
 		struct hashlistnode<_Key, _Val> *newtable;
 		unsigned int oldcapacity = capacity;
+		unsigned int oldgeneration = generation;
 
 		if ((newtable = (struct hashlistnode<_Key, _Val> *)_calloc(newsize, sizeof(struct hashlistnode<_Key, _Val>))) == NULL) {
 			model_print("calloc error %s %d\n", __FILE__, __LINE__);
@@ -184,38 +233,79 @@ class HashTable {
 		}
 
 		table = newtable;          // Update the global hashtable upon resize()
-		capacity = newsize;
-		capacitymask = newsize - 1;
-
-		threshold = (unsigned int)(newsize * loadfactor);
+		set_capacity(newsize);
+		generation = 1;
+		size = 0;
 
 		struct hashlistnode<_Key, _Val> *bin = &oldtable[0];
 		struct hashlistnode<_Key, _Val> *lastbin = &oldtable[oldcapacity];
-		for (; bin < lastbin; bin++) {
-			_Key key = bin->key;
+		for (; bin < lastbin; bin++)
+			if ((bin->meta >> HT_DIST_BITS) == oldgeneration)
+				put(bin->key, bin->val);
 
-			struct hashlistnode<_Key, _Val> *search;
+		_free(oldtable);            // Free the memory of the old hash table
+	}
 
-			unsigned int index = ((_KeyInt)key) >> _Shift;
-			do {
-				index &= capacitymask;
-				search = &table[index];
-				index++;
-			} while (search->key);
+ private:
+	/** @brief Compute a key's home slot */
+	unsigned int hash(_Key key) const {
+		/* Fibonacci hashing: the high bits of the product mix all of
+		 * the key's bits */
+		uint64_t h = ((uint64_t)(((_KeyInt)key) >> _Shift)) * 0x9E3779B97F4A7C15ULL;
+		return (unsigned int)(h >> hashshift) & capacitymask;
+	}
 
-			search->key = key;
-			search->val = bin->val;
+	/** @brief Find the slot holding key, or NULL */
+	struct hashlistnode<_Key, _Val> * find(_Key key) const {
+		unsigned int index = hash(key);
+		unsigned int dist = 0;
+		while (true) {
+			struct hashlistnode<_Key, _Val> *search = &table[index];
+			/* Robin Hood: key would have displaced a shorter run */
+			if (is_empty(search) || get_dist(search) < dist)
+				return NULL;
+			if (search->key == key)
+				return search;
+			index = (index + 1) & capacitymask;
+			dist++;
 		}
+	}
 
-		_free(oldtable);            // Free the memory of the old hash table
+	bool is_empty(const struct hashlistnode<_Key, _Val> *node) const {
+		return (node->meta >> HT_DIST_BITS) != generation;
+	}
+
+	static unsigned int get_dist(const struct hashlistnode<_Key, _Val> *node) {
+		return node->meta & HT_MAX_DIST;
+	}
+
+	unsigned int make_meta(unsigned int dist) const {
+		return (generation << HT_DIST_BITS) | dist;
+	}
+
+	void set_capacity(unsigned int newcapacity) {
+		capacity = newcapacity;
+		capacitymask = newcapacity - 1;
+		threshold = (unsigned int)(newcapacity * loadfactor);
+		hashshift = 64;
+		for (unsigned int c = newcapacity; c > 1; c >>= 1)
+			hashshift--;
+		/* A shift of 64 is undefined: for a capacity of 1, the mask in
+		 * hash() picks the (only) slot instead */
+		if (hashshift > 63)
+			hashshift = 63;
 	}
 
- private:
 	struct hashlistnode<_Key, _Val> *table;
 	unsigned int capacity;
 	unsigned int size;
 	unsigned int capacitymask;
 	unsigned int threshold;
+	/** @brief 64 - log2(capacity) (at most 63): selects the top bits of the
+	 *  hash */
+	unsigned int hashshift;
+	/** @brief The current generation; see hashlistnode::meta */
+	unsigned int generation;
 	double loadfactor;
 };
 
@@ -3,6 +3,7 @@
 #include "model.h"
 #include "threads-model.h"
 #include "action.h"
+#include "datarace.h"
 
 namespace std {
 
@@ -10,6 +11,7 @@ bool atomic_flag_test_and_set_explicit ( volatile atomic_flag * __a__, memory_or
 	volatile bool * __p__ = &((__a__)->__f__);
 	bool result = (bool) model->switch_to_master(new ModelAction(ATOMIC_RMWR, __x__, (void *) __p__));
 	model->switch_to_master(new ModelAction(ATOMIC_RMW, __x__, (void *) __p__, true));
+	raceCheckAtomicWrite(thread_current()->get_id(), (void *) __p__, sizeof(bool), __builtin_return_address(0));
 	return result;
 }
 
@@ -21,6 +23,7 @@ void atomic_flag_clear_explicit
 {
 	volatile bool * __p__ = &((__a__)->__f__);
 	model->switch_to_master(new ModelAction(ATOMIC_WRITE, __x__, (void *) __p__, false));
+	raceCheckAtomicWrite(thread_current()->get_id(), (void *) __p__, sizeof(bool), __builtin_return_address(0));
 }
 
 void atomic_flag_clear( volatile atomic_flag* __a__ )
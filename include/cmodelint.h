@@ -5,6 +5,7 @@
 #ifndef CMODELINT_H
 #define CMODELINT_H
 #include <inttypes.h>
+#include <stddef.h>
 #include "memoryorder.h"
 
 #if __cplusplus
@@ -20,6 +21,14 @@ void model_rmw_action(void *obj, memory_order ord, uint64_t val);
 void model_rmwc_action(void *obj, memory_order ord);
 void model_fence_action(memory_order ord);
 
+/* The same, with the size of the atomic object for the race detector (the
+ * ones above only check the object's first byte) */
+uint64_t model_read_action_sized(void * obj, memory_order ord, size_t size);
+void model_write_action_sized(void * obj, memory_order ord, uint64_t val, size_t size);
+void model_init_action_sized(void * obj, uint64_t val, size_t size);
+uint64_t model_rmwr_action_sized(void *obj, memory_order ord, size_t size);
+void model_rmw_action_sized(void *obj, memory_order ord, uint64_t val, size_t size);
+
 
 #if __cplusplus
 }
@@ -77,17 +77,25 @@ inline void atomic_flag::clear( memory_order __x__ ) volatile
         __g__=flag, __m__=modified, __o__=operation, __r__=result,
         __p__=pointer to field, __v__=value (for single evaluation),
         __x__=memory-ordering, and __y__=memory-ordering.
+
+        The model checker names an atomic access by the return address of
+        its call, so _ATOMIC_NO_TAIL_CALL_ keeps the calls out of tail
+        position, where they would return straight to the caller's caller.
 */
 
+#define _ATOMIC_NO_TAIL_CALL_() __asm__ __volatile__("")
+
 #define _ATOMIC_LOAD_( __a__, __x__ )                                         \
         ({ volatile __typeof__((__a__)->__f__)* __p__ = & ((__a__)->__f__);   \
-                __typeof__((__a__)->__f__) __r__ = (__typeof__((__a__)->__f__))model_read_action((void *)__p__, __x__);  \
+                __typeof__((__a__)->__f__) __r__ = (__typeof__((__a__)->__f__))model_read_action_sized((void *)__p__, __x__, sizeof(*__p__));  \
+                _ATOMIC_NO_TAIL_CALL_();                                      \
                 __r__; })
 
 #define _ATOMIC_STORE_( __a__, __m__, __x__ )                                 \
         ({ volatile __typeof__((__a__)->__f__)* __p__ = & ((__a__)->__f__);   \
                 __typeof__(__m__) __v__ = (__m__);                            \
-                model_write_action((void *) __p__,  __x__, (uint64_t) __v__); \
+                model_write_action_sized((void *) __p__,  __x__, (uint64_t) __v__, sizeof(*__p__)); \
+                _ATOMIC_NO_TAIL_CALL_();                                      \
                 __v__ = __v__; /* Silence clang (-Wunused-value) */           \
          })
 
@@ -95,17 +103,19 @@ inline void atomic_flag::clear( memory_order __x__ ) volatile
 #define _ATOMIC_INIT_( __a__, __m__ )                                         \
         ({ volatile __typeof__((__a__)->__f__)* __p__ = & ((__a__)->__f__);   \
                 __typeof__(__m__) __v__ = (__m__);                            \
-                model_init_action((void *) __p__,  (uint64_t) __v__);         \
+                model_init_action_sized((void *) __p__,  (uint64_t) __v__, sizeof(*__p__));  \
+                _ATOMIC_NO_TAIL_CALL_();                                      \
                 __v__ = __v__; /* Silence clang (-Wunused-value) */           \
          })
 
 #define _ATOMIC_MODIFY_( __a__, __o__, __m__, __x__ )                         \
         ({ volatile __typeof__((__a__)->__f__)* __p__ = & ((__a__)->__f__);   \
-        __typeof__((__a__)->__f__) __old__=(__typeof__((__a__)->__f__)) model_rmwr_action((void *)__p__, __x__); \
+        __typeof__((__a__)->__f__) __old__=(__typeof__((__a__)->__f__)) model_rmwr_action_sized((void *)__p__, __x__, sizeof(*__p__)); \
         __typeof__(__m__) __v__ = (__m__);                                    \
         __typeof__((__a__)->__f__) __copy__= __old__;                         \
         __copy__ __o__ __v__;                                                 \
-        model_rmw_action((void *)__p__, __x__, (uint64_t) __copy__);          \
+        model_rmw_action_sized((void *)__p__, __x__, (uint64_t) __copy__, sizeof(*__p__)); \
+        _ATOMIC_NO_TAIL_CALL_();                                              \
         __old__ = __old__; /* Silence clang (-Wunused-value) */               \
          })
 
@@ -117,10 +127,11 @@ inline void atomic_flag::clear( memory_order __x__ ) volatile
                 __typeof__(__e__) __q__ = (__e__);                            \
                 __typeof__(__m__) __v__ = (__m__);                            \
                 bool __r__;                                                   \
-                __typeof__((__a__)->__f__) __t__=(__typeof__((__a__)->__f__)) model_rmwr_action((void *)__p__, __x__); \
+                __typeof__((__a__)->__f__) __t__=(__typeof__((__a__)->__f__)) model_rmwr_action_sized((void *)__p__, __x__, sizeof(*__p__)); \
                 if (__t__ == * __q__ ) {                                      \
-                        model_rmw_action((void *)__p__, __x__, (uint64_t) __v__); __r__ = true; } \
+                        model_rmw_action_sized((void *)__p__, __x__, (uint64_t) __v__, sizeof(*__p__)); __r__ = true; } \
                 else {  model_rmwc_action((void *)__p__, __x__); *__q__ = __t__;  __r__ = false;} \
+                _ATOMIC_NO_TAIL_CALL_();                                      \
                 __r__; })
 
 #define _ATOMIC_FENCE_( __x__ ) \
@@ -2331,8 +2342,8 @@ inline void* atomic_fetch_add_explicit
 ( volatile atomic_address* __a__, ptrdiff_t __m__, memory_order __x__ )
 {
 	void* volatile* __p__ = &((__a__)->__f__);
-	void* __r__ = (void *) model_rmwr_action((void *)__p__, __x__);
-	model_rmw_action((void *)__p__, __x__, (uint64_t) ((char*)(*__p__) + __m__));
+	void* __r__ = (void *) model_rmwr_action_sized((void *)__p__, __x__, sizeof(*__p__));
+	model_rmw_action_sized((void *)__p__, __x__, (uint64_t) ((char*)(*__p__) + __m__), sizeof(*__p__));
   return __r__; }
 
 inline void* atomic_fetch_add
@@ -2344,8 +2355,8 @@ inline void* atomic_fetch_sub_explicit
 ( volatile atomic_address* __a__, ptrdiff_t __m__, memory_order __x__ )
 {
 	void* volatile* __p__ = &((__a__)->__f__);
-	void* __r__ = (void *) model_rmwr_action((void *)__p__, __x__);
-	model_rmw_action((void *)__p__, __x__, (uint64_t)((char*)(*__p__) - __m__));
+	void* __r__ = (void *) model_rmwr_action_sized((void *)__p__, __x__, sizeof(*__p__));
+	model_rmw_action_sized((void *)__p__, __x__, (uint64_t)((char*)(*__p__) - __m__), sizeof(*__p__));
   return __r__; }
 
 inline void* atomic_fetch_sub
@@ -6,6 +6,7 @@
 #define __LIBRACE_H__
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,8 +22,52 @@ extern "C" {
 	uint32_t load_32(const void *addr);
 	uint64_t load_64(const void *addr);
 
+	/* Check a whole region at once; the race_mem* wrappers check their
+	 * source and destination ranges, then perform the operation */
+	void race_check_read_range(const void *addr, size_t len);
+	void race_check_write_range(void *addr, size_t len);
+
+	void * race_memcpy(void *dst, const void *src, size_t len);
+	void * race_memmove(void *dst, const void *src, size_t len);
+	void * race_memset(void *dst, int c, size_t len);
+
+	/* Batched checks, as emitted by the instrumentation pass in
+	 * instrument/: the caller fetches its thread id once, then checks
+	 * several accesses with a single call */
+
+	/** @brief One access in a batch; info is (size << 1) | is_write, and
+	 *  site is the code address of the access (NULL to use the caller's) */
+	struct race_access {
+		const void *addr;
+		uint64_t info;
+		const void *site;
+	};
+
+	int race_thread_id(void);
+	void race_check_batch(int tid, const struct race_access *accesses, unsigned int count);
+
 #ifdef __cplusplus
 }
 #endif
 
+/* The race detector names each access by the return address of its librace
+ * call, so a call in tail position would be reported at the caller's caller:
+ * keep the calls to the single-access functions out of tail position */
+#if defined(__GNUC__) && !defined(LIBRACE_NO_WRAPPERS)
+#define __LIBRACE_STORE__(func, addr, val) \
+	({ (func)((addr), (val)); __asm__ __volatile__(""); })
+#define __LIBRACE_LOAD__(func, type, addr) \
+	({ type __r__ = (func)(addr); __asm__ __volatile__(""); __r__; })
+
+#define store_8(addr, val) __LIBRACE_STORE__(store_8, addr, val)
+#define store_16(addr, val) __LIBRACE_STORE__(store_16, addr, val)
+#define store_32(addr, val) __LIBRACE_STORE__(store_32, addr, val)
+#define store_64(addr, val) __LIBRACE_STORE__(store_64, addr, val)
+
+#define load_8(addr) __LIBRACE_LOAD__(load_8, uint8_t, addr)
+#define load_16(addr) __LIBRACE_LOAD__(load_16, uint16_t, addr)
+#define load_32(addr) __LIBRACE_LOAD__(load_32, uint32_t, addr)
+#define load_64(addr) __LIBRACE_LOAD__(load_64, uint64_t, addr)
+#endif
+
 #endif /* __LIBRACE_H__ */
@@ -24,6 +24,8 @@ extern "C" {
 	} thrd_t;
 
 	int thrd_create(thrd_t *t, thrd_start_t start_routine, void *arg);
+	/* Model-checker extension: see libthreads.cc */
+	int thrd_create_symmetric(thrd_t *t, thrd_start_t start_routine, void *arg);
 	int thrd_join(thrd_t);
 	void thrd_yield(void);
 	thrd_t thrd_current(void);
@@ -0,0 +1,316 @@
+/**
+ * @file RaceInstrument.cc
+ * @brief LLVM pass that instruments non-atomic loads and stores with calls to
+ * the librace batched race check
+ *
+ * Rather than one librace call per access, each basic block is cut into
+ * segments at calls (which may perform atomic operations, and so switch
+ * threads); the accesses of a segment are checked together with a single
+ * race_check_batch() call at the end of the segment. Within a segment:
+ *  - accesses of the same kind at constant offsets from the same base pointer
+ *    are merged into one range when they overlap or are adjacent,
+ *  - the current thread id is fetched (race_thread_id()) once per block, and
+ *  - accesses to stack slots whose address never escapes the function are
+ *    skipped, since no other thread can reach them.
+ *
+ * Memory intrinsics (memcpy, memmove and memset) are checked as ranges.
+ *
+ * Each batch entry carries the code address of its access (of the first one,
+ * for a merged range), so races are still told apart and reported per access:
+ * the access is split off to start a block of its own, and that block's
+ * address is passed. Functions whose block addresses are taken are no longer
+ * inlined, so run the pass after any inlining.
+ *
+ * Build it with 'make instrument' and run it with
+ *   opt -load-pass-plugin=instrument/RaceInstrument.so -passes=race-instrument
+ */
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/CaptureTracking.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace {
+
+/** @brief One access to check; mirrors struct race_access in librace.h */
+struct Access {
+	/** @brief The base pointer the access is at a constant offset from */
+	Value *base;
+	/** @brief The order in which base first appeared in the segment */
+	unsigned int baseindex;
+	int64_t offset;
+	/** @brief The access size, or NULL if the size is constant */
+	Value *dynsize;
+	uint64_t size;
+	bool iswrite;
+	/** @brief The instruction making the access */
+	Instruction *inst;
+};
+
+static bool accessBefore(const Access &a, const Access &b)
+{
+	if (a.baseindex != b.baseindex)
+		return a.baseindex < b.baseindex;
+	if (a.iswrite != b.iswrite)
+		return a.iswrite < b.iswrite;
+	return a.offset < b.offset;
+}
+
+class RaceInstrument {
+public:
+	RaceInstrument(Function &F) :
+		F(F),
+		M(*F.getParent()),
+		DL(M.getDataLayout()),
+		ctx(M.getContext()),
+		batcharray(NULL),
+		maxbatch(0)
+	{
+		Type *i8ptr = Type::getInt8PtrTy(ctx);
+		Type *i64 = Type::getInt64Ty(ctx);
+		Type *i32 = Type::getInt32Ty(ctx);
+		accesstype = StructType::get(ctx, { i8ptr, i64, i8ptr });
+		threadidfn = M.getOrInsertFunction("race_thread_id", i32);
+		batchfn = M.getOrInsertFunction("race_check_batch", Type::getVoidTy(ctx),
+				i32, PointerType::getUnqual(accesstype), i32);
+	}
+
+	bool run();
+
+private:
+	bool isThreadLocal(Value *ptr);
+	void addAccess(Instruction *inst, Value *ptr, Value *dynsize, uint64_t size, bool iswrite);
+	void flush(Instruction *before, Value *&tid);
+	void setSites();
+
+	Function &F;
+	Module &M;
+	const DataLayout &DL;
+	LLVMContext &ctx;
+	StructType *accesstype;
+	FunctionCallee threadidfn;
+	FunctionCallee batchfn;
+
+	/** @brief The stack slots whose address never escapes F */
+	SmallPtrSet<Value *, 16> localslots;
+	/** @brief The accesses of the current segment */
+	SmallVector<Access, 16> segment;
+	/** @brief The array of accesses passed to race_check_batch() */
+	AllocaInst *batcharray;
+	/** @brief The largest batch, which sizes batcharray */
+	unsigned int maxbatch;
+	/** @brief The stores of batch entry sites, with the access they name */
+	SmallVector<std::pair<StoreInst *, Instruction *>, 16> sitestores;
+};
+
+/** @return True if ptr only ever points into a non-escaping stack slot */
+bool RaceInstrument::isThreadLocal(Value *ptr)
+{
+	Value *obj = getUnderlyingObject(ptr);
+	if (localslots.count(obj))
+		return true;
+	if (GlobalVariable *gv = dyn_cast<GlobalVariable>(obj))
+		return gv->isConstant();
+	return false;
+}
+
+void RaceInstrument::addAccess(Instruction *inst, Value *ptr, Value *dynsize, uint64_t size, bool iswrite)
+{
+	if (isThreadLocal(ptr))
+		return;
+	Access a;
+	a.offset = 0;
+	a.base = dynsize ? ptr : GetPointerBaseWithConstantOffset(ptr, a.offset, DL);
+	a.baseindex = segment.size();
+	for (unsigned int i = 0; i < segment.size(); i++)
+		if (segment[i].base == a.base) {
+			a.baseindex = segment[i].baseindex;
+			break;
+		}
+	a.dynsize = dynsize;
+	a.size = size;
+	a.iswrite = iswrite;
+	a.inst = inst;
+	segment.push_back(a);
+}
+
+/** @return True if the constant-size range a lies within write */
+static bool coveredBy(const Access &a, const Access &write)
+{
+	return !a.dynsize && !write.dynsize && write.iswrite && a.base == write.base &&
+		write.offset <= a.offset &&
+		a.offset + (int64_t)a.size <= write.offset + (int64_t)write.size;
+}
+
+/**
+ * Emits the check for the current segment before the given instruction,
+ * merging overlapping or adjacent constant-size ranges. A read within a
+ * range the segment also writes is dropped, as the write check finds every
+ * race the read check would. The entries' sites are filled in by setSites().
+ * @param tid The current thread id for this block, fetched if still NULL
+ */
+void RaceInstrument::flush(Instruction *before, Value *&tid)
+{
+	if (segment.empty())
+		return;
+
+	std::stable_sort(segment.begin(), segment.end(), accessBefore);
+	SmallVector<Access, 16> merged;
+	for (unsigned int i = 0; i < segment.size(); i++) {
+		Access &a = segment[i];
+		if (!merged.empty()) {
+			Access &last = merged.back();
+			if (!a.dynsize && !last.dynsize && a.base == last.base &&
+					a.iswrite == last.iswrite &&
+					a.offset <= last.offset + (int64_t)last.size) {
+				int64_t end = std::max(last.offset + (int64_t)last.size, a.offset + (int64_t)a.size);
+				last.size = end - last.offset;
+				continue;
+			}
+		}
+		merged.push_back(a);
+	}
+	segment.clear();
+
+	/* Reads sort before writes to the same base */
+	for (unsigned int i = 0; i < merged.size(); i++) {
+		if (merged[i].iswrite)
+			continue;
+		for (unsigned int j = i + 1; j < merged.size() && merged[j].base == merged[i].base; j++)
+			if (coveredBy(merged[i], merged[j])) {
+				merged.erase(merged.begin() + i--);
+				break;
+			}
+	}
+
+	if (!batcharray) {
+		/* One array, in the entry block, serves every batch; its
+		 * length is fixed up once all batches are known */
+		IRBuilder<> entry(&*F.getEntryBlock().getFirstInsertionPt());
+		batcharray = entry.CreateAlloca(accesstype, entry.getInt32(1), "race.batch");
+	}
+
+	IRBuilder<> builder(before);
+	if (!tid)
+		tid = builder.CreateCall(threadidfn);
+
+	Type *i64 = Type::getInt64Ty(ctx);
+	Type *i8ptr = Type::getInt8PtrTy(ctx);
+	for (unsigned int i = 0; i < merged.size(); i++) {
+		Access &a = merged[i];
+		Value *addr = builder.CreatePointerCast(a.base, i8ptr);
+		if (a.offset != 0)
+			addr = builder.CreateConstGEP1_64(Type::getInt8Ty(ctx), addr, a.offset);
+		Value *info;
+		if (a.dynsize) {
+			info = builder.CreateShl(builder.CreateZExtOrTrunc(a.dynsize, i64), 1);
+			if (a.iswrite)
+				info = builder.CreateOr(info, 1);
+		} else
+			info = ConstantInt::get(i64, (a.size << 1) | a.iswrite);
+		Value *entry = builder.CreateConstGEP1_32(accesstype, batcharray, i);
+		builder.CreateStore(addr, builder.CreateStructGEP(accesstype, entry, 0));
+		builder.CreateStore(info, builder.CreateStructGEP(accesstype, entry, 1));
+		StoreInst *site = builder.CreateStore(ConstantPointerNull::get(cast<PointerType>(i8ptr)),
+				builder.CreateStructGEP(accesstype, entry, 2));
+		sitestores.push_back(std::make_pair(site, a.inst));
+	}
+	builder.CreateCall(batchfn, { tid, batcharray, builder.getInt32(merged.size()) });
+	maxbatch = std::max(maxbatch, (unsigned int)merged.size());
+}
+
+/**
+ * Points the site of each batch entry at its access. This splits blocks, so
+ * it runs once the whole function is instrumented.
+ */
+void RaceInstrument::setSites()
+{
+	for (unsigned int i = 0; i < sitestores.size(); i++) {
+		Instruction *inst = sitestores[i].second;
+		BasicBlock *BB = inst->getParent();
+		if (BB == &F.getEntryBlock() || BB->getFirstNonPHI() != inst)
+			BB = BB->splitBasicBlock(inst, "race.site");
+		Constant *site = ConstantExpr::getPointerCast(BlockAddress::get(&F, BB), Type::getInt8PtrTy(ctx));
+		sitestores[i].first->setOperand(0, site);
+	}
+}
+
+bool RaceInstrument::run()
+{
+	for (Instruction &I : F.getEntryBlock())
+		if (AllocaInst *AI = dyn_cast<AllocaInst>(&I))
+			if (!PointerMayBeCaptured(AI, true, true))
+				localslots.insert(AI);
+
+	for (BasicBlock &BB : F) {
+		Value *tid = NULL;
+		for (BasicBlock::iterator it = BB.begin(); it != BB.end(); ) {
+			Instruction *I = &*it++;
+			if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+				if (!LI->isAtomic())
+					addAccess(LI, LI->getPointerOperand(), NULL, DL.getTypeStoreSize(LI->getType()), false);
+			} else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+				if (!SI->isAtomic())
+					addAccess(SI, SI->getPointerOperand(), NULL, DL.getTypeStoreSize(SI->getValueOperand()->getType()), true);
+			} else if (MemIntrinsic *MI = dyn_cast<MemIntrinsic>(I)) {
+				ConstantInt *len = dyn_cast<ConstantInt>(MI->getLength());
+				if (MemTransferInst *MT = dyn_cast<MemTransferInst>(MI))
+					addAccess(MI, MT->getSource(), len ? NULL : MI->getLength(), len ? len->getZExtValue() : 0, false);
+				addAccess(MI, MI->getDest(), len ? NULL : MI->getLength(), len ? len->getZExtValue() : 0, true);
+			} else if (isa<IntrinsicInst>(I)) {
+				/* Other intrinsics neither access memory on the
+				 * program's behalf nor switch threads */
+			} else if (isa<CallBase>(I) || I->isTerminator()) {
+				flush(I, tid);
+			}
+		}
+	}
+
+	if (!batcharray)
+		return false;
+	batcharray->setOperand(0, ConstantInt::get(Type::getInt32Ty(ctx), maxbatch));
+	setSites();
+	return true;
+}
+
+struct RaceInstrumentPass : PassInfoMixin<RaceInstrumentPass> {
+	PreservedAnalyses run(Function &F, FunctionAnalysisManager &AM) {
+		if (F.isDeclaration() || F.getName().startswith("race_"))
+			return PreservedAnalyses::all();
+		RaceInstrument instrument(F);
+		return instrument.run() ? PreservedAnalyses::none() : PreservedAnalyses::all();
+	}
+};
+
+} // namespace
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo()
+{
+	return {
+		LLVM_PLUGIN_API_VERSION, "RaceInstrument", "v0.1",
+		[](PassBuilder &PB) {
+			PB.registerPipelineParsingCallback(
+				[](StringRef name, FunctionPassManager &FPM,
+						ArrayRef<PassBuilder::PipelineElement>) {
+					if (name == "race-instrument") {
+						FPM.addPass(RaceInstrumentPass());
+						return true;
+					}
+					return false;
+				});
+		}
+	};
+}
@@ -1,6 +1,9 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <string.h>
 
+/* The definitions below are the functions themselves */
+#define LIBRACE_NO_WRAPPERS
 #include "librace.h"
 #include "common.h"
 #include "datarace.h"
@@ -11,7 +14,7 @@ void store_8(void *addr, uint8_t val)
 {
 	DEBUG("addr = %p, val = %" PRIu8 "\n", addr, val);
 	thread_id_t tid = thread_current()->get_id();
-	raceCheckWrite(tid, addr);
+	raceCheckWrite(tid, addr, 1, __builtin_return_address(0));
 	(*(uint8_t *)addr) = val;
 }
 
@@ -19,8 +22,7 @@ void store_16(void *addr, uint16_t val)
 {
 	DEBUG("addr = %p, val = %" PRIu16 "\n", addr, val);
 	thread_id_t tid = thread_current()->get_id();
-	raceCheckWrite(tid, addr);
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 1));
+	raceCheckWrite(tid, addr, 2, __builtin_return_address(0));
 	(*(uint16_t *)addr) = val;
 }
 
@@ -28,10 +30,7 @@ void store_32(void *addr, uint32_t val)
 {
 	DEBUG("addr = %p, val = %" PRIu32 "\n", addr, val);
 	thread_id_t tid = thread_current()->get_id();
-	raceCheckWrite(tid, addr);
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 1));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 2));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 3));
+	raceCheckWrite(tid, addr, 4, __builtin_return_address(0));
 	(*(uint32_t *)addr) = val;
 }
 
@@ -39,14 +38,7 @@ void store_64(void *addr, uint64_t val)
 {
 	DEBUG("addr = %p, val = %" PRIu64 "\n", addr, val);
 	thread_id_t tid = thread_current()->get_id();
-	raceCheckWrite(tid, addr);
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 1));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 2));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 3));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 4));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 5));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 6));
-	raceCheckWrite(tid, (void *)(((uintptr_t)addr) + 7));
+	raceCheckWrite(tid, addr, 8, __builtin_return_address(0));
 	(*(uint64_t *)addr) = val;
 }
 
@@ -54,7 +46,7 @@ uint8_t load_8(const void *addr)
 {
 	DEBUG("addr = %p\n", addr);
 	thread_id_t tid = thread_current()->get_id();
-	raceCheckRead(tid, addr);
+	raceCheckRead(tid, addr, 1, __builtin_return_address(0));
 	return *((uint8_t *)addr);
 }
 
@@ -62,8 +54,7 @@ uint16_t load_16(const void *addr)
 {
 	DEBUG("addr = %p\n", addr);
 	thread_id_t tid = thread_current()->get_id();
-	raceCheckRead(tid, addr);
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 1));
+	raceCheckRead(tid, addr, 2, __builtin_return_address(0));
 	return *((uint16_t *)addr);
 }
 
@@ -71,10 +62,7 @@ uint32_t load_32(const void *addr)
 {
 	DEBUG("addr = %p\n", addr);
 	thread_id_t tid = thread_current()->get_id();
-	raceCheckRead(tid, addr);
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 1));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 2));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 3));
+	raceCheckRead(tid, addr, 4, __builtin_return_address(0));
 	return *((uint32_t *)addr);
 }
 
@@ -82,13 +70,67 @@ uint64_t load_64(const void *addr)
 {
 	DEBUG("addr = %p\n", addr);
 	thread_id_t tid = thread_current()->get_id();
-	raceCheckRead(tid, addr);
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 1));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 2));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 3));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 4));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 5));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 6));
-	raceCheckRead(tid, (const void *)(((uintptr_t)addr) + 7));
+	raceCheckRead(tid, addr, 8, __builtin_return_address(0));
 	return *((uint64_t *)addr);
 }
+
+void race_check_read_range(const void *addr, size_t len)
+{
+	DEBUG("addr = %p, len = %zu\n", addr, len);
+	thread_id_t tid = thread_current()->get_id();
+	raceCheckReadRange(tid, addr, len, __builtin_return_address(0));
+}
+
+void race_check_write_range(void *addr, size_t len)
+{
+	DEBUG("addr = %p, len = %zu\n", addr, len);
+	thread_id_t tid = thread_current()->get_id();
+	raceCheckWriteRange(tid, addr, len, __builtin_return_address(0));
+}
+
+void * race_memcpy(void *dst, const void *src, size_t len)
+{
+	DEBUG("dst = %p, src = %p, len = %zu\n", dst, src, len);
+	thread_id_t tid = thread_current()->get_id();
+	raceCheckReadRange(tid, src, len, __builtin_return_address(0));
+	raceCheckWriteRange(tid, dst, len, __builtin_return_address(0));
+	return memcpy(dst, src, len);
+}
+
+void * race_memmove(void *dst, const void *src, size_t len)
+{
+	DEBUG("dst = %p, src = %p, len = %zu\n", dst, src, len);
+	thread_id_t tid = thread_current()->get_id();
+	raceCheckReadRange(tid, src, len, __builtin_return_address(0));
+	raceCheckWriteRange(tid, dst, len, __builtin_return_address(0));
+	return memmove(dst, src, len);
+}
+
+void * race_memset(void *dst, int c, size_t len)
+{
+	DEBUG("dst = %p, len = %zu\n", dst, len);
+	thread_id_t tid = thread_current()->get_id();
+	raceCheckWriteRange(tid, dst, len, __builtin_return_address(0));
+	return memset(dst, c, len);
+}
+
+int race_thread_id(void)
+{
+	return id_to_int(thread_current()->get_id());
+}
+
+void race_check_batch(int tid, const struct race_access *accesses, unsigned int count)
+{
+	DEBUG("tid = %d, count = %u\n", tid, count);
+	thread_id_t thread = int_to_id(tid);
+	for (unsigned int i = 0; i < count; i++) {
+		size_t size = accesses[i].info >> 1;
+		const void *site = accesses[i].site;
+		if (!site)
+			site = __builtin_return_address(0);
+		if (accesses[i].info & 1)
+			raceCheckWriteRange(thread, (void *)accesses[i].addr, size, site);
+		else
+			raceCheckReadRange(thread, accesses[i].addr, size, site);
+	}
+}
@@ -11,12 +11,26 @@
  */
 int thrd_create(thrd_t *t, thrd_start_t start_routine, void *arg)
 {
-	struct thread_params params = { start_routine, arg };
+	struct thread_params params = { start_routine, arg, false };
 	/* seq_cst is just a 'don't care' parameter */
 	model->switch_to_master(new ModelAction(THREAD_CREATE, std::memory_order_seq_cst, t, (uint64_t)&params));
 	return 0;
 }
 
+/**
+ * Like thrd_create(), but also promises that the new thread is interchangeable
+ * with the threads its parent created just before it, with this function and
+ * the same start routine: swapping their arguments changes nothing that
+ * matters. With symmetry reduction (-X), the model checker explores
+ * executions that only differ by such a swap once.
+ */
+int thrd_create_symmetric(thrd_t *t, thrd_start_t start_routine, void *arg)
+{
+	struct thread_params params = { start_routine, arg, true };
+	model->switch_to_master(new ModelAction(THREAD_CREATE, std::memory_order_seq_cst, t, (uint64_t)&params));
+	return 0;
+}
+
 int thrd_join(thrd_t t)
 {
 	Thread *th = t.priv;
@@ -5,6 +5,9 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <string.h>
+#ifndef MAC
+#include <sys/personality.h>
+#endif
 
 #include "common.h"
 #include "output.h"
@@ -17,6 +20,7 @@
 #include "snapshot-interface.h"
 #include "scanalysis.h"
 #include "plugins.h"
+#include "threads-model.h"
 
 static void param_defaults(struct model_params *params)
 {
@@ -25,12 +29,20 @@ static void param_defaults(struct model_params *params)
 	params->fairwindow = 0;
 	params->yieldon = false;
 	params->yieldblock = false;
+	params->spinblock = false;
+	params->symmetry = false;
 	params->enabledcount = 1;
 	params->bound = 0;
 	params->maxfuturevalues = 0;
 	params->expireslop = 4;
 	params->verbose = !!DBG_ENABLED();
 	params->uninitvalue = 0;
+	params->suppressions = NULL;
+	params->racestats = false;
+	params->checkpoint = NULL;
+	params->checkpointinterval = 300;
+	params->record = NULL;
+	params->replay = NULL;
 }
 
 static void print_usage(const char *program_name, struct model_params *params)
@@ -68,6 +80,14 @@ static void print_usage(const char *program_name, struct model_params *params)
 "                              Default: %s\n"
 "-Y, --yieldblock            Prohibit an execution from running a yield.\n"
 "                              Default: %s\n"
+"-L, --spinblock             Block a thread whose reads since its last side\n"
+"                              effect repeat one iteration (same call sites, same\n"
+"                              stores), until another thread writes a location it\n"
+"                              has read or no other thread can run.\n"
+"                              Default: %s\n"
+"-X, --symmetry              Explore executions that only differ by swapping\n"
+"                              threads created with thrd_create_symmetric() once.\n"
+"                              Default: %s\n"
 "-f, --fairness=WINDOW       Specify a fairness window in which actions that are\n"
 "                              enabled sufficiently many times should receive\n"
 "                              priority for execution (not recommended).\n"
@@ -82,6 +102,22 @@ static void print_usage(const char *program_name, struct model_params *params)
 "-u, --uninitialized=VALUE   Return VALUE any load which may read from an\n"
 "                              uninitialized atomic.\n"
 "                              Default: %u\n"
+"-r, --suppressions=FILE     Do not check the memory or call sites listed in FILE\n"
+"                              for data races (see datarace.cc).\n"
+"-R, --race-stats            Print the race detector's memory use, check counts\n"
+"                              and time with the end-of-run statistics.\n"
+"-c, --checkpoint=FILE       Periodically save the exploration to FILE, and if\n"
+"                              FILE exists, resume the exploration it holds.\n"
+"                              FILE is removed when the exploration completes.\n"
+"-C, --checkpoint-interval=SECS\n"
+"                            Minimum time between checkpoints (0 saves one after\n"
+"                              every execution).\n"
+"                              Default: %u\n"
+"-P, --record=PREFIX         Save the choices taken by each buggy execution N to\n"
+"                              the file PREFIX.N.\n"
+"-p, --replay=FILE           Run only the execution whose choices were saved to\n"
+"                              FILE (with the same program, arguments and\n"
+"                              options).\n"
 "-t, --analysis=NAME         Use Analysis Plugin.\n"
 "-o, --options=NAME          Option for previous analysis plugin.  \n"
 "                            -o help for a list of options\n"
@@ -93,11 +129,14 @@ static void print_usage(const char *program_name, struct model_params *params)
 		params->expireslop,
 		params->yieldon ? "enabled" : "disabled",
 		params->yieldblock ? "enabled" : "disabled",
+		params->spinblock ? "enabled" : "disabled",
+		params->symmetry ? "enabled" : "disabled",
 		params->fairwindow,
 		params->enabledcount,
 		params->bound,
 		params->verbose,
-		params->uninitvalue);
+		params->uninitvalue,
+		params->checkpointinterval);
 	model_print("Analysis plugins:\n");
 	for(unsigned int i=0;i<registeredanalysis->size();i++) {
 		TraceAnalysis * analysis=(*registeredanalysis)[i];
@@ -123,7 +162,7 @@ bool install_plugin(char * name) {
 
 static void parse_options(struct model_params *params, int argc, char **argv)
 {
-	const char *shortopts = "hyYt:o:m:M:s:S:f:e:b:u:v::";
+	const char *shortopts = "hyYLXt:o:m:M:s:S:f:e:b:u:r:Rc:C:P:p:v::";
 	const struct option longopts[] = {
 		{"help", no_argument, NULL, 'h'},
 		{"liveness", required_argument, NULL, 'm'},
@@ -133,10 +172,18 @@ static void parse_options(struct model_params *params, int argc, char **argv)
 		{"fairness", required_argument, NULL, 'f'},
 		{"yield", no_argument, NULL, 'y'},
 		{"yieldblock", no_argument, NULL, 'Y'},
+		{"spinblock", no_argument, NULL, 'L'},
+		{"symmetry", no_argument, NULL, 'X'},
 		{"enabled", required_argument, NULL, 'e'},
 		{"bound", required_argument, NULL, 'b'},
 		{"verbose", optional_argument, NULL, 'v'},
 		{"uninitialized", optional_argument, NULL, 'u'},
+		{"suppressions", required_argument, NULL, 'r'},
+		{"race-stats", no_argument, NULL, 'R'},
+		{"checkpoint", required_argument, NULL, 'c'},
+		{"checkpoint-interval", required_argument, NULL, 'C'},
+		{"record", required_argument, NULL, 'P'},
+		{"replay", required_argument, NULL, 'p'},
 		{"analysis", optional_argument, NULL, 't'},
 		{"options", optional_argument, NULL, 'o'},
 		{0, 0, 0, 0} /* Terminator */
@@ -175,6 +222,24 @@ static void parse_options(struct model_params *params, int argc, char **argv)
 		case 'u':
 			params->uninitvalue = atoi(optarg);
 			break;
+		case 'r':
+			params->suppressions = optarg;
+			break;
+		case 'R':
+			params->racestats = true;
+			break;
+		case 'c':
+			params->checkpoint = optarg;
+			break;
+		case 'C':
+			params->checkpointinterval = atoi(optarg);
+			break;
+		case 'P':
+			params->record = optarg;
+			break;
+		case 'p':
+			params->replay = optarg;
+			break;
 		case 'y':
 			params->yieldon = true;
 			break;
@@ -192,12 +257,22 @@ static void parse_options(struct model_params *params, int argc, char **argv)
 		case 'Y':
 			params->yieldblock = true;
 			break;
+		case 'L':
+			params->spinblock = true;
+			break;
+		case 'X':
+			params->symmetry = true;
+			break;
 		default: /* '?' */
 			error = true;
 			break;
 		}
 	}
 
+	/* A replay is a single execution, which must not touch a checkpoint */
+	if (params->replay)
+		params->checkpoint = NULL;
+
 	/* Pass remaining arguments to user program */
 	params->argc = argc - (optind - 1);
 	params->argv = argv + (optind - 1);
@@ -237,11 +312,20 @@ static void model_main()
 
 	//Initialize race detector
 	initRaceDetector();
+	if (params.suppressions)
+		loadRaceSuppressions(params.suppressions);
+	if (params.racestats)
+		enableRaceStats();
 
 	snapshot_stack_init();
+	stack_pool_init();
 
 	model = new ModelChecker(params);
 	install_trace_analyses(model->get_execution());
+	if (params.replay)
+		model->load_replay();
+	else if (params.checkpoint)
+		model->restore_checkpoint();
 
 	snapshot_record(0);
 	model->run();
@@ -250,6 +334,24 @@ static void model_main()
 	DEBUG("Exiting\n");
 }
 
+/**
+ * Checkpoints refer to the user program's memory by address, so they can only
+ * be resumed in the same address space layout: when checkpointing, restart
+ * without address space randomization. If that fails, a resumed run will
+ * refuse the checkpoint.
+ */
+static void disable_aslr(char **argv)
+{
+#ifndef MAC
+	int persona = personality(0xffffffff);
+	if (persona == -1 || (persona & ADDR_NO_RANDOMIZE))
+		return;
+	if (personality(persona | ADDR_NO_RANDOMIZE) == -1)
+		return;
+	execv("/proc/self/exe", argv);
+#endif
+}
+
 /**
  * Main function.  Just initializes snapshotting library and the
  * snapshotting library calls the model_main function.
@@ -259,6 +361,10 @@ int main(int argc, char **argv)
 	main_argc = argc;
 	main_argv = argv;
 
+	for (int i = 1; i < argc && strcmp(argv[i], "--"); i++)
+		if (!strncmp(argv[i], "-c", 2) || !strncmp(argv[i], "--checkpoint", 12))
+			disable_aslr(argv);
+
 	/* Configure output redirection for the model-checker */
 	redirect_output();
 
@@ -2,6 +2,12 @@
 #include <algorithm>
 #include <new>
 #include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "model.h"
 #include "action.h"
@@ -15,6 +21,7 @@
 #include "traceanalysis.h"
 #include "execution.h"
 #include "bugmessage.h"
+#include "checkpoint.h"
 
 ModelChecker *model;
 
@@ -28,7 +35,9 @@ ModelChecker::ModelChecker(struct model_params params) :
 	execution_number(1),
 	diverge(NULL),
 	earliest_diverge(NULL),
-	trace_analyses()
+	chosen_thread(NULL),
+	trace_analyses(),
+	last_checkpoint(time(NULL))
 {
 }
 
@@ -57,6 +66,7 @@ void ModelChecker::reset_to_initial_state()
 		delete get_thread(int_to_id(i))->get_pending();
 
 	snapshot_backtrack_before(0);
+	resetRaceDetector();
 }
 
 /** @return the number of user threads created during this execution */
@@ -95,8 +105,13 @@ Thread * ModelChecker::get_next_thread()
 	 * Have we completed exploring the preselected path? Then let the
 	 * scheduler decide
 	 */
-	if (diverge == NULL)
+	if (diverge == NULL) {
+		/* Are we replaying a recorded choice sequence? */
+		tid = node_stack->get_replay_thread();
+		if (tid != THREAD_ID_T_NONE)
+			return get_thread(tid);
 		return scheduler->select_next_thread(node_stack->get_head());
+	}
 
 
 	/* Else, we are trying to replay an execution */
@@ -243,6 +258,8 @@ void ModelChecker::print_stats() const
 	model_print("Total executions: %d\n", stats.num_total);
 	if (params.verbose)
 		model_print("Total nodes created: %d\n", node_stack->get_total_nodes());
+	if (params.racestats)
+		printRaceStats();
 }
 
 /**
@@ -308,9 +325,16 @@ bool ModelChecker::next_execution()
 	else
 		clear_program_output();
 
+	if (complete && execution->have_bug_reports() && params.record)
+		save_choices();
+
 	if (complete)
 		earliest_diverge = NULL;
 
+	/* A replay is a single execution */
+	if (params.replay)
+		return false;
+
 	if ((diverge = execution->get_next_backtrack()) == NULL)
 		return false;
 
@@ -321,10 +345,201 @@ bool ModelChecker::next_execution()
 
 	execution_number++;
 
+	if (params.checkpoint && time(NULL) - last_checkpoint >= (time_t)params.checkpointinterval)
+		save_checkpoint();
+
 	reset_to_initial_state();
 	return true;
 }
 
+/** @brief Mix some bytes into a (FNV-1a) hash */
+static void hash_bytes(uint64_t *hash, const void *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		*hash ^= ((const unsigned char *)buf)[i];
+		*hash *= 0x100000001b3ULL;
+	}
+}
+
+/**
+ * @return A hash of what a checkpointed exploration depends on: the options
+ * that shape it, the program and its arguments, and where the program and the
+ * model checker are loaded
+ */
+uint64_t ModelChecker::checkpoint_fingerprint() const
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	const int options[] = {
+		params.maxreads, params.maxfuturedelay, params.yieldon,
+		params.yieldblock, params.spinblock,
+		params.symmetry, (int)params.fairwindow,
+		(int)params.enabledcount, (int)params.bound,
+		(int)params.uninitvalue, params.maxfuturevalues,
+		(int)params.expireslop,
+	};
+	hash_bytes(&hash, options, sizeof(options));
+
+	for (int i = 1; i < params.argc; i++)
+		hash_bytes(&hash, params.argv[i], strlen(params.argv[i]) + 1);
+
+	struct stat st;
+	if (stat("/proc/self/exe", &st) == 0) {
+		hash_bytes(&hash, &st.st_size, sizeof(st.st_size));
+		hash_bytes(&hash, &st.st_mtime, sizeof(st.st_mtime));
+	}
+
+	const void *layout[] = { &model, (void *)&user_main };
+	hash_bytes(&hash, layout, sizeof(layout));
+	return hash;
+}
+
+/**
+ * @brief Save the exploration so far to the checkpoint file
+ *
+ * Must be called between executions, once the next divergence point is
+ * known. The checkpoint is written to a temporary file and then renamed, so a
+ * run that dies while saving leaves the previous checkpoint intact.
+ */
+void ModelChecker::save_checkpoint()
+{
+	char tmpname[PATH_MAX];
+	snprintf(tmpname, sizeof(tmpname), "%s.tmp", params.checkpoint);
+	int fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		perror(tmpname);
+		return;
+	}
+
+	Checkpoint ckpt(fd);
+	ckpt.put(CHECKPOINT_MAGIC);
+	ckpt.put(checkpoint_fingerprint());
+	ckpt.put(execution_number);
+	ckpt.put(stats.num_total);
+	ckpt.put(stats.num_infeasible);
+	ckpt.put(stats.num_buggy_executions);
+	ckpt.put(stats.num_complete);
+	ckpt.put(stats.num_redundant);
+	node_stack->save(&ckpt);
+	node_stack->save_action_ref(&ckpt, diverge);
+	node_stack->save_action_ref(&ckpt, earliest_diverge);
+
+	bool ok = ckpt.flush();
+	if (close(fd) || !ok || rename(tmpname, params.checkpoint)) {
+		model_print("Could not save checkpoint %s\n", params.checkpoint);
+		unlink(tmpname);
+		return;
+	}
+	last_checkpoint = time(NULL);
+}
+
+/**
+ * @brief Resume the exploration saved in the checkpoint file, if it exists
+ *
+ * Must be called before the first execution. Exits if the checkpoint cannot
+ * be used, since it would then explore the wrong executions.
+ *
+ * @return True if the exploration was resumed; false if there was no
+ * checkpoint
+ */
+bool ModelChecker::restore_checkpoint()
+{
+	int fd = open(params.checkpoint, O_RDONLY);
+	if (fd < 0) {
+		if (errno == ENOENT)
+			return false;
+		perror(params.checkpoint);
+		exit(EXIT_FAILURE);
+	}
+
+	Checkpoint ckpt(fd);
+	if (ckpt.get() != CHECKPOINT_MAGIC) {
+		model_print("%s is not a checkpoint\n", params.checkpoint);
+		exit(EXIT_FAILURE);
+	}
+	if (ckpt.get() != checkpoint_fingerprint()) {
+		model_print("Checkpoint %s was saved for a different program, program arguments,\n"
+				"model-checker options or address space layout\n", params.checkpoint);
+		exit(EXIT_FAILURE);
+	}
+	execution_number = ckpt.get();
+	stats.num_total = ckpt.get();
+	stats.num_infeasible = ckpt.get();
+	stats.num_buggy_executions = ckpt.get();
+	stats.num_complete = ckpt.get();
+	stats.num_redundant = ckpt.get();
+	/* The model-checker thread is thread 0 */
+	if (node_stack->load(&ckpt, get_thread(int_to_id(0)))) {
+		diverge = node_stack->load_action_ref(&ckpt);
+		earliest_diverge = node_stack->load_action_ref(&ckpt);
+	}
+	close(fd);
+	if (ckpt.failed() || diverge == NULL) {
+		model_print("Checkpoint %s is corrupt\n", params.checkpoint);
+		exit(EXIT_FAILURE);
+	}
+
+	model_print("Resuming from checkpoint %s at execution %d\n",
+			params.checkpoint, execution_number);
+	last_checkpoint = time(NULL);
+	return true;
+}
+
+/**
+ * @brief Save the choices taken by the current execution, so that it can be
+ * replayed on its own
+ * @see ModelChecker::load_replay()
+ */
+void ModelChecker::save_choices()
+{
+	char name[PATH_MAX];
+	snprintf(name, sizeof(name), "%s.%d", params.record, execution_number);
+	int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		perror(name);
+		return;
+	}
+
+	Checkpoint ckpt(fd);
+	ckpt.put(CHOICES_MAGIC);
+	ckpt.put(execution_number);
+	node_stack->save_choices(&ckpt);
+
+	bool ok = ckpt.flush();
+	if (close(fd) || !ok) {
+		model_print("Could not save the choices to %s\n", name);
+		return;
+	}
+	model_print("Choices saved to %s (replay with --replay=%s)\n", name, name);
+}
+
+/**
+ * @brief Load the choice sequence saved by save_choices(), for the first (and
+ * only) execution to replay
+ *
+ * Exits if the sequence cannot be loaded.
+ */
+void ModelChecker::load_replay()
+{
+	int fd = open(params.replay, O_RDONLY);
+	if (fd < 0) {
+		perror(params.replay);
+		exit(EXIT_FAILURE);
+	}
+
+	Checkpoint ckpt(fd);
+	if (ckpt.get() != CHOICES_MAGIC) {
+		model_print("%s is not a recorded choice sequence\n", params.replay);
+		exit(EXIT_FAILURE);
+	}
+	execution_number = ckpt.get();
+	bool ok = node_stack->load_choices(&ckpt);
+	close(fd);
+	if (!ok) {
+		model_print("Choice sequence %s is corrupt\n", params.replay);
+		exit(EXIT_FAILURE);
+	}
+}
+
 /** @brief Run trace analyses on complete trace */
 void ModelChecker::run_trace_analyses() {
 	for (unsigned int i = 0; i < trace_analyses.size(); i++)
@@ -354,7 +569,8 @@ Thread * ModelChecker::get_thread(const ModelAction *act) const
 /**
  * Switch from a model-checker context to a user-thread context. This is the
  * complement of ModelChecker::switch_to_master and must be called from the
- * model-checker context
+ * model-checker context. User threads hand off to each other directly, so
+ * this only returns at the end of the execution.
  *
  * @param thread The user-thread to switch to
  */
@@ -370,6 +586,12 @@ void ModelChecker::switch_from_master(Thread *thread)
  * model-checking action (described by a ModelAction object). Must be called
  * from a user-thread context.
  *
+ * The steps of the execution are taken right here, on the user thread's
+ * stack, up to the point where some thread has to run to produce its next
+ * action. Control then passes straight to that thread (or simply returns, if
+ * it is this one); only the end of the execution goes back to the master
+ * context.
+ *
  * @param act The current action that will be explored. May be NULL only if
  * trace is exiting via an assertion (see ModelExecution::set_assert and
  * ModelExecution::has_asserted).
@@ -382,7 +604,22 @@ uint64_t ModelChecker::switch_to_master(ModelAction *act)
 	scheduler->set_current_thread(NULL);
 	ASSERT(!old->get_pending());
 	old->set_pending(act);
-	if (Thread::swap(old, &system_context) < 0) {
+	old->set_state(THREAD_READY);
+	if (old->is_waiting_on(old))
+		assert_bug("Deadlock detected (thread %u)", id_to_int(old->get_id()));
+
+	Thread *next = take_steps();
+	int ret = 0;
+	if (next == old) {
+		scheduler->set_current_thread(old);
+		old->set_state(THREAD_RUNNING);
+	} else if (next) {
+		scheduler->set_current_thread(next);
+		ret = Thread::swap(old, next);
+	} else {
+		ret = Thread::swap(old, &system_context);
+	}
+	if (ret < 0) {
 		perror("swap threads");
 		exit(EXIT_FAILURE);
 	}
@@ -410,6 +647,60 @@ bool ModelChecker::should_terminate_execution()
 	return false;
 }
 
+/**
+ * @brief Take steps of the execution until some thread has to run
+ *
+ * May be called from the master context or from a user thread that has just
+ * stashed its next action (see ModelChecker::switch_to_master).
+ *
+ * @return The thread to run to produce its next action, or NULL if the
+ * execution is over
+ */
+Thread * ModelChecker::take_steps()
+{
+	while (true) {
+		/*
+		 * Stash next pending action(s) for thread(s). There should
+		 * only need to stash one thread's action--the thread which
+		 * just took a step--plus the first step for any newly-created
+		 * thread
+		 */
+		for (unsigned int i = 0; i < get_num_threads(); i++) {
+			Thread *thr = get_thread(int_to_id(i));
+			if (!thr->is_model_thread() && !thr->is_complete() && !thr->get_pending())
+				return thr;
+		}
+
+		/* Don't schedule threads which should be disabled */
+		for (unsigned int i = 0; i < get_num_threads(); i++) {
+			Thread *th = get_thread(int_to_id(i));
+			ModelAction *act = th->get_pending();
+			if (act && execution->is_enabled(th) && !execution->check_action_enabled(act)) {
+				scheduler->sleep(th);
+			}
+		}
+		if (params.spinblock)
+			execution->wake_up_spin_blocked_threads();
+
+		/* Catch assertions from prior take_step or from
+		 * between-ModelAction bugs (e.g., data races) */
+		if (execution->has_asserted())
+			return NULL;
+
+		if (!chosen_thread)
+			chosen_thread = get_next_thread();
+		if (!chosen_thread || chosen_thread->is_model_thread())
+			return NULL;
+
+		/* Consume the next action for a Thread */
+		ModelAction *curr = chosen_thread->get_pending();
+		chosen_thread->set_pending(NULL);
+		chosen_thread = execution->take_step(curr);
+		if (should_terminate_execution())
+			return NULL;
+	}
+}
+
 /** @brief Run ModelChecker for the user program */
 void ModelChecker::run()
 {
@@ -417,55 +708,24 @@ void ModelChecker::run()
 		thrd_t user_thread;
 		Thread *t = new Thread(execution->get_next_id(), &user_thread, &user_main_wrapper, NULL, NULL);
 		execution->add_thread(t);
+		chosen_thread = t;
 
-		do {
-			/*
-			 * Stash next pending action(s) for thread(s). There
-			 * should only need to stash one thread's action--the
-			 * thread which just took a step--plus the first step
-			 * for any newly-created thread
-			 */
-			for (unsigned int i = 0; i < get_num_threads(); i++) {
-				thread_id_t tid = int_to_id(i);
-				Thread *thr = get_thread(tid);
-				if (!thr->is_model_thread() && !thr->is_complete() && !thr->get_pending()) {
-					switch_from_master(thr);
-					if (thr->is_waiting_on(thr))
-						assert_bug("Deadlock detected (thread %u)", i);
-				}
-			}
-
-			/* Don't schedule threads which should be disabled */
-			for (unsigned int i = 0; i < get_num_threads(); i++) {
-				Thread *th = get_thread(int_to_id(i));
-				ModelAction *act = th->get_pending();
-				if (act && execution->is_enabled(th) && !execution->check_action_enabled(act)) {
-					scheduler->sleep(th);
-				}
-			}
-
-			/* Catch assertions from prior take_step or from
-			 * between-ModelAction bugs (e.g., data races) */
-			if (execution->has_asserted())
-				break;
-
-			if (!t)
-				t = get_next_thread();
-			if (!t || t->is_model_thread())
-				break;
-
-			/* Consume the next action for a Thread */
-			ModelAction *curr = t->get_pending();
-			t->set_pending(NULL);
-			t = execution->take_step(curr);
-		} while (!should_terminate_execution());
-
+		/* The user threads take the steps from here on, and switch
+		 * back when the execution is over */
+		Thread *thr = take_steps();
+		if (thr)
+			switch_from_master(thr);
 	} while (next_execution());
 
+	/* Nothing is left to resume */
+	if (params.checkpoint)
+		unlink(params.checkpoint);
+
 	execution->fixup_release_sequences();
 
 	model_print("******* Model-checking complete: *******\n");
 	print_stats();
+	printRaceReports();
 
 	/* Have the trace analyses dump their output. */
 	for (unsigned int i = 0; i < trace_analyses.size(); i++)
@@ -7,6 +7,7 @@
 
 #include <cstddef>
 #include <inttypes.h>
+#include <time.h>
 
 #include "mymemory.h"
 #include "hashtable.h"
@@ -48,7 +49,7 @@ public:
 	void run();
 
 	/** @returns the context for the main model-checking system thread */
-	ucontext_t * get_system_context() { return &system_context; }
+	model_context_t * get_system_context() { return &system_context; }
 
 	ModelExecution * get_execution() const { return execution; }
 
@@ -70,6 +71,9 @@ public:
 		trace_analyses.push_back(a);
 	}
 
+	bool restore_checkpoint();
+	void load_replay();
+
 	MEMALLOC
 private:
 	/** The scheduler to use: tracks the running/ready Threads */
@@ -87,13 +91,18 @@ private:
 	bool should_terminate_execution();
 
 	Thread * get_next_thread();
+	Thread * take_steps();
 	void reset_to_initial_state();
 
 
 	ModelAction *diverge;
 	ModelAction *earliest_diverge;
 
-	ucontext_t system_context;
+	/** @brief The thread whose pending action is to be taken next, if
+	 *  already chosen */
+	Thread *chosen_thread;
+
+	model_context_t system_context;
 
 	ModelVector<TraceAnalysis *> trace_analyses;
 
@@ -105,6 +114,12 @@ private:
 	void print_execution(bool printbugs) const;
 	void print_stats() const;
 
+	/** @brief When the last checkpoint was saved (or restored) */
+	time_t last_checkpoint;
+	uint64_t checkpoint_fingerprint() const;
+	void save_checkpoint();
+	void save_choices();
+
 	friend void user_main_wrapper();
 };
 
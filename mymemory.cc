@@ -124,7 +124,7 @@ void model_free(void *ptr)
 /** Bootstrap allocation. Problem is that the dynamic linker calls require
  *  calloc to work and calloc requires the dynamic linker to work. */
 
-#define BOOTSTRAPBYTES 4096
+#define BOOTSTRAPBYTES (1 << 20)
 char bootstrapmemory[BOOTSTRAPBYTES];
 size_t offset = 0;
 
@@ -180,7 +180,7 @@ void *malloc(size_t size)
 {
 	if (user_snapshot_space) {
 		/* Only perform user allocations from user context */
-		ASSERT(!model || thread_current());
+//		ASSERT(!model || thread_current());
 		return user_malloc(size);
 	} else
 		return HandleEarlyAllocationRequest(size);
@@ -2,6 +2,7 @@
 #include <inttypes.h>
 
 #include <string.h>
+#include <new>
 
 #include "nodestack.h"
 #include "action.h"
@@ -10,6 +11,61 @@
 #include "modeltypes.h"
 #include "execution.h"
 #include "params.h"
+#include "checkpoint.h"
+
+NodeArena::NodeArena() :
+	chunks(),
+	curr(0),
+	top(NULL)
+{
+}
+
+NodeArena::~NodeArena()
+{
+	for (unsigned int i = 0; i < chunks.size(); i++)
+		model_free(chunks[i].base);
+}
+
+/**
+ * @brief Allocate space from the top of the arena
+ * @param size The number of bytes needed
+ * @return The space, aligned for any type the Nodes hold
+ */
+void * NodeArena::allocate(size_t size)
+{
+	size = (size + 15) & ~(size_t)15;
+	if (!chunks.empty() && top + size <= chunks[curr].base + chunks[curr].size) {
+		void *ret = top;
+		top += size;
+		return ret;
+	}
+
+	/* Move on to the next chunk, unless there is none big enough */
+	if (!chunks.empty())
+		curr++;
+	if (curr == chunks.size() || chunks[curr].size < size) {
+		struct arena_chunk chunk;
+		chunk.size = size > NODE_ARENA_CHUNK_SIZE ? size : NODE_ARENA_CHUNK_SIZE;
+		chunk.base = (char *)model_malloc(chunk.size);
+		chunks.insert(chunks.begin() + curr, chunk);
+	}
+	top = chunks[curr].base + size;
+	return chunks[curr].base;
+}
+
+/**
+ * @brief Free everything allocated since (and including) a given allocation
+ * @param mark An allocation returned by allocate()
+ */
+void NodeArena::release(void *mark)
+{
+	char *m = (char *)mark;
+	while (m < chunks[curr].base || m >= chunks[curr].base + chunks[curr].size) {
+		ASSERT(curr > 0);
+		curr--;
+	}
+	top = m;
+}
 
 /**
  * @brief Node constructor
@@ -25,53 +81,68 @@
  * parent.
  * @param nthreads The number of threads which exist at this point in the
  * execution trace.
+ * @param arena The arena this Node was allocated from, for its per-thread
+ * arrays
  */
 Node::Node(const struct model_params *params, ModelAction *act, Node *par,
-		int nthreads, Node *prevfairness) :
-	read_from_status(READ_FROM_PAST),
+		int nthreads, Node *prevfairness, NodeArena *arena) :
 	action(act),
 	params(params),
 	uninit_action(NULL),
 	parent(par),
 	num_threads(nthreads),
-	explored_children(num_threads),
-	backtrack(num_threads),
-	fairness(num_threads),
-	numBacktracks(0),
-	enabled_array(NULL),
+	read_from_status(READ_FROM_PAST),
+	explored(),
+	backtrack(),
+	enabled(),
+	runnable(),
+	depth(par ? par->depth + 1 : 0),
+	fairness(NULL),
+	priority(),
+	yield_data(NULL),
 	read_from_past(),
-	read_from_past_idx(0),
 	read_from_promises(),
-	read_from_promise_idx(-1),
 	future_values(),
-	future_index(-1),
 	resolve_promise(),
-	resolve_promise_idx(-1),
 	relseq_break_writes(),
+	read_from_past_idx(0),
+	read_from_promise_idx(-1),
+	future_index(-1),
+	resolve_promise_idx(-1),
 	relseq_break_index(0),
 	misc_index(0),
-	misc_max(0),
-	yield_data(NULL)
+	misc_max(0)
 {
 	ASSERT(act);
 	act->set_node(this);
+	if (params->yieldon) {
+		/* The thread taking this step gets new rows: always one of
+		 * disabled threads, and one of priorities if it yields */
+		size_t size = sizeof(struct yield_info) * num_threads +
+			yield_row_size() * (act->is_yield() ? 2 : 1);
+		yield_data = (struct yield_info *)arena->allocate(size);
+		memset(yield_data, 0, size);
+	}
 	int currtid = id_to_int(act->get_tid());
 	int prevtid = prevfairness ? id_to_int(prevfairness->action->get_tid()) : 0;
 
 	if (get_params()->fairwindow != 0) {
+		fairness = (struct fairness_info *)arena->allocate(sizeof(struct fairness_info) * num_threads);
+		memset(fairness, 0, sizeof(struct fairness_info) * num_threads);
 		for (int i = 0; i < num_threads; i++) {
-			ASSERT(i < ((int)fairness.size()));
 			struct fairness_info *fi = &fairness[i];
 			struct fairness_info *prevfi = (parent && i < parent->get_num_threads()) ? &parent->fairness[i] : NULL;
+			bool has_priority = false;
 			if (prevfi) {
 				*fi = *prevfi;
+				has_priority = parent->priority.contains(i);
 			}
 			if (parent && parent->is_enabled(int_to_id(i))) {
 				fi->enabled_count++;
 			}
 			if (i == currtid) {
 				fi->turns++;
-				fi->priority = false;
+				has_priority = false;
 			}
 			/* Do window processing */
 			if (prevfairness != NULL) {
@@ -86,59 +157,104 @@ Node::Node(const struct model_params *params, ModelAction *act, Node *par,
 				 * turns, give us priority */
 				if ((fi->enabled_count >= get_params()->enabledcount) &&
 						(fi->turns == 0))
-					fi->priority = true;
+					has_priority = true;
 			}
+			if (has_priority)
+				priority.add(i);
 		}
 	}
 }
 
-int Node::get_yield_data(int tid1, int tid2) const {
-	if (tid1<num_threads && tid2 < num_threads)
-		return yield_data[YIELD_INDEX(tid1,tid2,num_threads)];
-	else
-		return YIELD_S | YIELD_D;
+/** @return The size of a yield row for this Node's threads */
+size_t Node::yield_row_size() const
+{
+	return sizeof(struct yield_row) + sizeof(uint64_t) * ((num_threads + 63) / 64 - 1);
 }
 
-void Node::update_yield(Scheduler * scheduler) {
-	if (yield_data==NULL)
-		yield_data=(int *) model_calloc(1, sizeof(int)*num_threads*num_threads);
-	//handle base case
+/**
+ * @return The i'th yield row allocated along with this Node (0: disabled
+ * threads, 1: priorities)
+ */
+struct yield_row * Node::get_own_yield_row(int i) const
+{
+	return (struct yield_row *)((char *)(yield_data + num_threads) + yield_row_size() * i);
+}
+
+/**
+ * @brief Compute the yield bookkeeping after this Node's action, from the
+ * parent Node's bookkeeping
+ *
+ * Only the steps of the threads that are disabled now, and the rows of the
+ * thread taking this step, change.
+ *
+ * @param scheduler The Scheduler, holding which threads are now enabled
+ */
+void Node::update_yield(Scheduler * scheduler)
+{
+	ASSERT(yield_data);
+	const ThreadSet<> &next_enabled = scheduler->get_enabled_set();
 	if (parent == NULL) {
-		for(int i = 0; i < num_threads*num_threads; i++) {
-			yield_data[i] = YIELD_S | YIELD_D;
+		for (int i = 0; i < num_threads; i++) {
+			struct yield_info *yi = &yield_data[i];
+			yi->yield_step = -1;
+			yi->last_run = yi->last_disabled = yi->created = depth;
+			yi->disabled = yi->priority = NULL;
 		}
 		return;
 	}
-	int curr_tid=id_to_int(action->get_tid());
-
-	for(int u = 0; u < num_threads; u++) {
-		for(int v = 0; v < num_threads; v++) {
-			int yield_state=parent->get_yield_data(u, v);
-			bool next_enabled=scheduler->is_enabled(int_to_id(v));
-			bool curr_enabled=parent->is_enabled(int_to_id(v));
-			if (!next_enabled) {
-				//Compute intersection of ES and E
-				yield_state&=~YIELD_E;
-				//Check to see if we disabled the thread
-				if (u==curr_tid && curr_enabled)
-					yield_state|=YIELD_D;
-			}
-			yield_data[YIELD_INDEX(u, v, num_threads)]=yield_state;
+	ASSERT(parent->yield_data);
+
+	for (int i = 0; i < num_threads; i++) {
+		struct yield_info *yi = &yield_data[i];
+		if (i < parent->num_threads) {
+			*yi = parent->yield_data[i];
+		} else {
+			/* A new thread: as if it ran and was disabled by every
+			 * thread, but was not enabled before this step */
+			yi->yield_step = -1;
+			yi->last_run = yi->created = depth;
+			yi->last_disabled = depth - 1;
+			yi->disabled = yi->priority = NULL;
 		}
-		yield_data[YIELD_INDEX(u, curr_tid, num_threads)]=(yield_data[YIELD_INDEX(u, curr_tid, num_threads)]&~YIELD_P)|YIELD_S;
+		if (!next_enabled.contains(i))
+			yi->last_disabled = depth;
 	}
-	//handle curr.yield(t) part of computation
+
+	int curr_tid = id_to_int(action->get_tid());
+	struct yield_info *curr = &yield_data[curr_tid];
+	int old_yield_step = curr->yield_step;
+
+	/* The current thread disabled the threads which were enabled before
+	 * this step, but are not now */
+	struct yield_row *disabled = get_own_yield_row(0);
+	disabled->numwords = (num_threads + 63) / 64;
+	for (unsigned int w = 0; w < disabled->numwords; w++)
+		disabled->bits[w] = yield_row_word(curr->disabled, w) |
+			(parent->enabled.get_word(w) & ~next_enabled.get_word(w));
+	curr->disabled = disabled;
+	curr->last_run = depth;
+
+	/* The current thread yields in favor of the threads that were enabled
+	 * or disabled by it, but did not run, since its last yield, and keeps
+	 * its priority over the threads that still have not run */
 	if (action->is_yield()) {
-		for(int v = 0; v < num_threads; v++) {
-			int yield_state=yield_data[YIELD_INDEX(curr_tid, v, num_threads)];
-			if ((yield_state & (YIELD_E | YIELD_D)) && (!(yield_state & YIELD_S)))
-				yield_state |= YIELD_P;
-			yield_state &= YIELD_P;
-			if (scheduler->is_enabled(int_to_id(v))) {
-				yield_state|=YIELD_E;
-			}
-			yield_data[YIELD_INDEX(curr_tid, v, num_threads)]=yield_state;
+		struct yield_row *prio = get_own_yield_row(1);
+		prio->numwords = disabled->numwords;
+		memset(prio->bits, 0, sizeof(uint64_t) * prio->numwords);
+		for (int v = 0; v < num_threads; v++) {
+			const struct yield_info *yv = &yield_data[v];
+			bool was_enabled = yv->last_disabled < old_yield_step;
+			bool was_disabled = yv->created > old_yield_step ||
+				((yield_row_word(curr->disabled, v >> 6) >> (v & 63)) & 1);
+			bool has_run = yv->last_run > old_yield_step;
+			bool had_priority = ((yield_row_word(curr->priority, v >> 6) >> (v & 63)) & 1) &&
+				yv->last_run < old_yield_step;
+			if (((was_enabled || was_disabled) && !has_run) || had_priority)
+				prio->bits[v >> 6] |= 1ULL << (v & 63);
 		}
+		curr->priority = prio;
+		curr->disabled = NULL;
+		curr->yield_step = depth;
 	}
 }
 
@@ -148,10 +264,8 @@ Node::~Node()
 	delete action;
 	if (uninit_action)
 		delete uninit_action;
-	if (enabled_array)
-		model_free(enabled_array);
-	if (yield_data)
-		model_free(yield_data);
+	/* fairness and yield_data are released along with the Node's arena
+	 * space */
 }
 
 /** Prints debugging info for the ModelAction associated with this Node */
@@ -159,19 +273,18 @@ void Node::print() const
 {
 	action->print();
 	model_print("          thread status: ");
-	if (enabled_array) {
+	if (!enabled.empty()) {
 		for (int i = 0; i < num_threads; i++) {
 			char str[20];
-			enabled_type_to_string(enabled_array[i], str);
+			enabled_type_to_string(enabled_status(int_to_id(i)), str);
 			model_print("[%d: %s]", i, str);
 		}
 		model_print("\n");
 	} else
 		model_print("(info not available)\n");
 	model_print("          backtrack: %s", backtrack_empty() ? "empty" : "non-empty ");
-	for (int i = 0; i < (int)backtrack.size(); i++)
-		if (backtrack[i] == true)
-			model_print("[%d]", i);
+	for (int i = backtrack.next(0); i >= 0; i = backtrack.next(i + 1))
+		model_print("[%d]", i);
 	model_print("\n");
 
 	model_print("          read from past: %s", read_from_past_empty() ? "empty" : "non-empty ");
@@ -205,8 +318,7 @@ void Node::print() const
  */
 bool Node::has_been_explored(thread_id_t tid) const
 {
-	int id = id_to_int(tid);
-	return explored_children[id];
+	return explored.contains(id_to_int(tid));
 }
 
 /**
@@ -215,33 +327,31 @@ bool Node::has_been_explored(thread_id_t tid) const
  */
 bool Node::backtrack_empty() const
 {
-	return (numBacktracks == 0);
+	return backtrack.empty();
 }
 
 void Node::explore(thread_id_t tid)
 {
 	int i = id_to_int(tid);
-	ASSERT(i < ((int)backtrack.size()));
-	if (backtrack[i]) {
-		backtrack[i] = false;
-		numBacktracks--;
-	}
-	explored_children[i] = true;
+	ASSERT(i < num_threads);
+	backtrack.remove(i);
+	explored.add(i);
 }
 
 /**
  * Mark the appropriate backtracking information for exploring a thread choice.
  * @param act The ModelAction to explore
+ * @param scheduler The Scheduler, holding which threads were enabled when act
+ * was chosen. May be NULL, if no thread was enabled.
  */
-void Node::explore_child(ModelAction *act, enabled_type_t *is_enabled)
+void Node::explore_child(ModelAction *act, const Scheduler *scheduler)
 {
-	if (!enabled_array)
-		enabled_array = (enabled_type_t *)model_malloc(sizeof(enabled_type_t) * num_threads);
-	if (is_enabled != NULL)
-		memcpy(enabled_array, is_enabled, sizeof(enabled_type_t) * num_threads);
-	else {
-		for (int i = 0; i < num_threads; i++)
-			enabled_array[i] = THREAD_DISABLED;
+	if (scheduler != NULL) {
+		enabled.copy_from(scheduler->get_enabled_set(), num_threads);
+		runnable.copy_from(scheduler->get_runnable_set(), num_threads);
+	} else {
+		enabled.clear();
+		runnable.clear();
 	}
 
 	explore(act->get_tid());
@@ -257,36 +367,38 @@ void Node::explore_child(ModelAction *act, enabled_type_t *is_enabled)
 bool Node::set_backtrack(thread_id_t id)
 {
 	int i = id_to_int(id);
-	ASSERT(i < ((int)backtrack.size()));
-	if (backtrack[i])
+	ASSERT(i < num_threads);
+	if (backtrack.contains(i))
 		return false;
-	backtrack[i] = true;
-	numBacktracks++;
+	backtrack.add(i);
 	return true;
 }
 
 thread_id_t Node::get_next_backtrack()
 {
-	/** @todo Find next backtrack */
-	unsigned int i;
-	for (i = 0; i < backtrack.size(); i++)
-		if (backtrack[i] == true)
-			break;
+	int i = backtrack.next(0);
 	/* Backtrack set was empty? */
-	ASSERT(i != backtrack.size());
+	ASSERT(i >= 0);
 
-	backtrack[i] = false;
-	numBacktracks--;
+	backtrack.remove(i);
 	return int_to_id(i);
 }
 
+/**
+ * Finds a thread choice that could still be explored from this Node: one that
+ * was enabled and not sleeping, and that has not been explored yet.
+ * @param from The lowest thread ID to consider
+ * @return The lowest such thread ID that is at least from, or -1 if none
+ */
+int Node::get_next_unexplored(int from) const
+{
+	return runnable.next_excluding(from, explored);
+}
+
 void Node::clear_backtracking()
 {
-	for (unsigned int i = 0; i < backtrack.size(); i++)
-		backtrack[i] = false;
-	for (unsigned int i = 0; i < explored_children.size(); i++)
-		explored_children[i] = false;
-	numBacktracks = 0;
+	backtrack.clear();
+	explored.clear();
 }
 
 /************************** end threads backtracking **************************/
@@ -375,35 +487,66 @@ bool Node::misc_empty() const
 
 bool Node::is_enabled(Thread *t) const
 {
-	int thread_id = id_to_int(t->get_id());
-	return thread_id < num_threads && (enabled_array[thread_id] != THREAD_DISABLED);
+	return enabled.contains(id_to_int(t->get_id()));
 }
 
 enabled_type_t Node::enabled_status(thread_id_t tid) const
 {
 	int thread_id = id_to_int(tid);
-	if (thread_id < num_threads)
-		return enabled_array[thread_id];
-	else
-		return THREAD_DISABLED;
+	if (runnable.contains(thread_id))
+		return THREAD_ENABLED;
+	return enabled.contains(thread_id) ? THREAD_SLEEP_SET : THREAD_DISABLED;
 }
 
 bool Node::is_enabled(thread_id_t tid) const
 {
-	int thread_id = id_to_int(tid);
-	return thread_id < num_threads && (enabled_array[thread_id] != THREAD_DISABLED);
+	return enabled.contains(id_to_int(tid));
 }
 
 bool Node::has_priority(thread_id_t tid) const
 {
-	return fairness[id_to_int(tid)].priority;
+	return priority.contains(id_to_int(tid));
 }
 
+/** @return True if thread tid1 yielded in favor of thread tid2 */
 bool Node::has_priority_over(thread_id_t tid1, thread_id_t tid2) const
 {
-	return get_yield_data(id_to_int(tid1), id_to_int(tid2)) & YIELD_P;
+	int u = id_to_int(tid1), v = id_to_int(tid2);
+	if (yield_data == NULL || u >= num_threads || v >= num_threads)
+		return false;
+	const struct yield_info *yi = &yield_data[u];
+	return ((yield_row_word(yi->priority, v >> 6) >> (v & 63)) & 1) &&
+		yield_data[v].last_run < yi->yield_step;
+}
+
+/**
+ * @return True if thread tid yielded in favor of any of the given threads,
+ * which may then run before it
+ */
+template<typename _Set>
+bool Node::has_priority_over_any(thread_id_t tid, const _Set &threads) const
+{
+	int u = id_to_int(tid);
+	if (yield_data == NULL || u >= num_threads)
+		return false;
+	const struct yield_info *yi = &yield_data[u];
+	if (yi->priority == NULL)
+		return false;
+	for (unsigned int w = 0; w < yi->priority->numwords; w++) {
+		uint64_t word = yi->priority->bits[w] & threads.get_word(w);
+		while (word) {
+			int v = (w << 6) + __builtin_ctzll(word);
+			word &= word - 1;
+			if (v < num_threads && yield_data[v].last_run < yi->yield_step)
+				return true;
+		}
+	}
+	return false;
 }
 
+template bool Node::has_priority_over_any(thread_id_t, const ThreadSet<> &) const;
+template bool Node::has_priority_over_any(thread_id_t, const ModelThreadSet &) const;
+
 /*********************************** read from ********************************/
 
 /**
@@ -751,6 +894,215 @@ bool Node::increment_behaviors()
 	return false;
 }
 
+/******************************** checkpoints *********************************/
+
+/**
+ * @brief Write the thread choices of this Node to a checkpoint
+ *
+ * They are written along with the Node itself, since the fairness of its
+ * child is computed from them when the child is rebuilt.
+ */
+void Node::save_threads(Checkpoint *ckpt) const
+{
+	ckpt->put_set(explored);
+	ckpt->put_set(backtrack);
+	ckpt->put_set(enabled);
+	ckpt->put_set(runnable);
+}
+
+/** @brief Read the thread choices written by save_threads() */
+void Node::load_threads(Checkpoint *ckpt)
+{
+	ckpt->get_set(&explored);
+	ckpt->get_set(&backtrack);
+	ckpt->get_set(&enabled);
+	ckpt->get_set(&runnable);
+	if (explored.next(num_threads) >= 0 || backtrack.next(num_threads) >= 0 ||
+			enabled.next(num_threads) >= 0 || runnable.next(num_threads) >= 0)
+		ckpt->fail();
+}
+
+/**
+ * @brief Write the behaviors of this Node (may-read-from sets, future values,
+ * promise resolutions, etc.) to a checkpoint, along with how far they have
+ * been explored
+ * @param ckpt The checkpoint
+ * @param stack The NodeStack, which encodes references to ModelActions
+ */
+void Node::save_behaviors(Checkpoint *ckpt, const NodeStack *stack) const
+{
+	ckpt->put(read_from_status);
+
+	ckpt->put(read_from_past.size());
+	for (unsigned int i = 0; i < read_from_past.size(); i++)
+		stack->save_action_ref(ckpt, read_from_past[i], depth);
+	ckpt->put(read_from_past_idx);
+
+	ckpt->put(read_from_promises.size());
+	for (unsigned int i = 0; i < read_from_promises.size(); i++)
+		stack->save_action_ref(ckpt, read_from_promises[i]);
+	ckpt->put_signed(read_from_promise_idx);
+
+	ckpt->put(future_values.size());
+	for (unsigned int i = 0; i < future_values.size(); i++) {
+		ckpt->put(future_values[i].value);
+		ckpt->put(future_values[i].expiration);
+		ckpt->put(id_to_int(future_values[i].tid));
+	}
+	ckpt->put_signed(future_index);
+
+	ckpt->put(resolve_promise.size());
+	for (unsigned int i = 0; i < resolve_promise.size(); i++)
+		ckpt->put(resolve_promise[i]);
+	ckpt->put_signed(resolve_promise_idx);
+
+	ckpt->put(relseq_break_writes.size());
+	for (unsigned int i = 0; i < relseq_break_writes.size(); i++)
+		stack->save_action_ref(ckpt, relseq_break_writes[i]);
+	ckpt->put_signed(relseq_break_index);
+
+	ckpt->put_signed(misc_index);
+	ckpt->put_signed(misc_max);
+
+	/* Only computed when the action is first explored */
+	stack->save_action_ref(ckpt, action->get_last_fence_release());
+}
+
+/** @brief Read the behaviors written by save_behaviors() */
+void Node::load_behaviors(Checkpoint *ckpt, const NodeStack *stack)
+{
+	unsigned int num;
+
+	read_from_status = (read_from_type_t)ckpt->get();
+
+	num = ckpt->get();
+	for (unsigned int i = 0; i < num && !ckpt->failed(); i++)
+		read_from_past.push_back(stack->load_action_ref(ckpt));
+	read_from_past_idx = ckpt->get();
+
+	num = ckpt->get();
+	for (unsigned int i = 0; i < num && !ckpt->failed(); i++)
+		read_from_promises.push_back(stack->load_action_ref(ckpt));
+	read_from_promise_idx = ckpt->get_signed();
+
+	num = ckpt->get();
+	for (unsigned int i = 0; i < num && !ckpt->failed(); i++) {
+		struct future_value fv;
+		fv.value = ckpt->get();
+		fv.expiration = ckpt->get();
+		fv.tid = int_to_id(ckpt->get());
+		future_values.push_back(fv);
+	}
+	future_index = ckpt->get_signed();
+
+	num = ckpt->get();
+	for (unsigned int i = 0; i < num && !ckpt->failed(); i++)
+		resolve_promise.push_back(ckpt->get() != 0);
+	resolve_promise_idx = ckpt->get_signed();
+
+	num = ckpt->get();
+	for (unsigned int i = 0; i < num && !ckpt->failed(); i++)
+		relseq_break_writes.push_back(stack->load_action_ref(ckpt));
+	relseq_break_index = ckpt->get_signed();
+
+	misc_index = ckpt->get_signed();
+	misc_max = ckpt->get_signed();
+
+	action->set_last_fence_release(stack->load_action_ref(ckpt));
+
+	for (unsigned int i = 0; i < read_from_past.size(); i++)
+		if (read_from_past[i] == NULL)
+			ckpt->fail();
+	for (unsigned int i = 0; i < read_from_promises.size(); i++)
+		if (read_from_promises[i] == NULL)
+			ckpt->fail();
+}
+
+/**
+ * @brief Write the choices taken at this Node in the current execution: the
+ * action's thread, what it read from, and which of its other behaviors it
+ * took
+ * @param ckpt The file to write to
+ * @param stack The NodeStack, which encodes references to ModelActions
+ */
+void Node::save_choices(Checkpoint *ckpt, const NodeStack *stack) const
+{
+	ckpt->put(id_to_int(action->get_tid()));
+	ckpt->put(read_from_status);
+	switch (read_from_status) {
+	case READ_FROM_PAST:
+		stack->save_action_ref(ckpt, get_read_from_past(), depth);
+		break;
+	case READ_FROM_PROMISE:
+		stack->save_action_ref(ckpt, read_from_promises[read_from_promise_idx]);
+		break;
+	case READ_FROM_FUTURE:
+		ckpt->put(future_values[future_index].value);
+		ckpt->put(future_values[future_index].expiration);
+		ckpt->put(id_to_int(future_values[future_index].tid));
+		break;
+	default:
+		break;
+	}
+	ckpt->put_signed(resolve_promise_idx);
+	ckpt->put_signed(relseq_break_index);
+	ckpt->put_signed(misc_index);
+}
+
+/**
+ * @brief Take the recorded choices for this newly-explored Node
+ *
+ * Must be called once the Node's may-read-from set, release sequence breaks
+ * and misc range are built. The action read from is looked up in the
+ * may-read-from set, rather than recorded by index, since the set can be
+ * larger than it was when the choices were recorded (e.g., without the sleep
+ * sets of that execution).
+ *
+ * @param step The recorded choices
+ * @param read_from The action read from (or the reader of the promise read
+ * from), if any
+ * @return False if the choices are not available at this Node
+ */
+bool Node::set_choices(const struct replay_step *step, const ModelAction *read_from)
+{
+	read_from_status = step->read_from_status;
+	switch (read_from_status) {
+	case READ_FROM_PAST:
+		if (!read_from)
+			break;
+		for (read_from_past_idx = 0; read_from_past_idx < read_from_past.size(); read_from_past_idx++)
+			if (read_from_past[read_from_past_idx] == read_from)
+				break;
+		if (read_from_past_idx == read_from_past.size())
+			return false;
+		break;
+	case READ_FROM_PROMISE:
+		for (read_from_promise_idx = 0; read_from_promise_idx < (int)read_from_promises.size(); read_from_promise_idx++)
+			if (read_from_promises[read_from_promise_idx] == read_from)
+				break;
+		if (read_from_promise_idx == (int)read_from_promises.size())
+			return false;
+		break;
+	case READ_FROM_FUTURE:
+		future_values.push_back(step->future_value);
+		future_index = future_values.size() - 1;
+		break;
+	default:
+		break;
+	}
+
+	resolve_promise_idx = step->resolve_promise_idx;
+	relseq_break_index = step->relseq_break_index;
+	misc_index = step->misc_index;
+	/* An RMW's promises are only computed with its second half, so
+	 * resolve_promise_idx can't be checked yet */
+	return resolve_promise_idx >= -1 &&
+		relseq_break_index >= 0 && relseq_break_index <= (int)relseq_break_writes.size() &&
+		misc_index >= 0 && (misc_index == 0 || misc_index < misc_max);
+}
+
+/****************************** end checkpoints *******************************/
+
 NodeStack::NodeStack() :
 	node_list(),
 	head_idx(-1),
@@ -762,7 +1114,7 @@ NodeStack::NodeStack() :
 NodeStack::~NodeStack()
 {
 	for (unsigned int i = 0; i < node_list.size(); i++)
-		delete node_list[i];
+		node_list[i]->~Node();
 }
 
 /**
@@ -791,9 +1143,9 @@ void NodeStack::print() const
 	model_print("............................................\n");
 }
 
-/** Note: The is_enabled set contains what actions were enabled when
+/** Note: The scheduler's enabled sets contain what actions were enabled when
  *  act was chosen. */
-ModelAction * NodeStack::explore_action(ModelAction *act, enabled_type_t *is_enabled)
+ModelAction * NodeStack::explore_action(ModelAction *act, const Scheduler *scheduler)
 {
 	DBG();
 
@@ -804,20 +1156,35 @@ ModelAction * NodeStack::explore_action(ModelAction *act, enabled_type_t *is_ena
 
 	/* Record action */
 	Node *head = get_head();
-	Node *prevfairness = NULL;
-	if (head) {
-		head->explore_child(act, is_enabled);
-		if (get_params()->fairwindow != 0 && head_idx > (int)get_params()->fairwindow)
-			prevfairness = node_list[head_idx - get_params()->fairwindow];
-	}
+	if (head)
+		head->explore_child(act, scheduler);
 
 	int next_threads = execution->get_num_threads();
 	if (act->get_type() == THREAD_CREATE)
 		next_threads++;
-	node_list.push_back(new Node(get_params(), act, head, next_threads, prevfairness));
+	push_node(act, next_threads);
+	return NULL;
+}
+
+/**
+ * @brief Push a new Node, as the child of the current head Node
+ * @param act The new Node's action
+ * @param nthreads The number of threads which exist after act
+ * @return The new Node, which is now the head
+ */
+Node * NodeStack::push_node(ModelAction *act, int nthreads)
+{
+	Node *head = get_head();
+	Node *prevfairness = NULL;
+	if (head && get_params()->fairwindow != 0 && head_idx > (int)get_params()->fairwindow)
+		prevfairness = node_list[head_idx - get_params()->fairwindow];
+
+	void *mem = arena.allocate(sizeof(Node));
+	Node *node = ::new (mem) Node(get_params(), act, head, nthreads, prevfairness, &arena);
+	node_list.push_back(node);
 	total_nodes++;
 	head_idx++;
-	return NULL;
+	return node;
 }
 
 /**
@@ -832,8 +1199,13 @@ void NodeStack::pop_restofstack(int numAhead)
 {
 	/* Diverging from previous execution; clear out remainder of list */
 	unsigned int it = head_idx + numAhead;
-	for (unsigned int i = it; i < node_list.size(); i++)
-		delete node_list[i];
+	if (it < node_list.size()) {
+		for (unsigned int i = it; i < node_list.size(); i++)
+			node_list[i]->~Node();
+		/* Nodes are allocated in stack order, so this frees every
+		 * popped Node */
+		arena.release(node_list[it]);
+	}
 	node_list.resize(it);
 	node_list.back()->clear_backtracking();
 }
@@ -863,3 +1235,221 @@ void NodeStack::reset_execution()
 {
 	head_idx = -1;
 }
+
+/**
+ * @brief Write a reference to a ModelAction held by this NodeStack
+ *
+ * Actions are referred to by the index of the Node which holds them, either
+ * as its action or as its ATOMIC_UNINIT action.
+ *
+ * @param ckpt The checkpoint
+ * @param act The action; may be NULL
+ * @param hint The index of the Node most likely to hold act, if it is an
+ * ATOMIC_UNINIT action, or -1
+ */
+void NodeStack::save_action_ref(Checkpoint *ckpt, const ModelAction *act, int hint) const
+{
+	if (act == NULL) {
+		ckpt->put(0);
+		return;
+	}
+	if (!act->is_uninitialized()) {
+		ckpt->put(2 * act->get_node()->get_depth() + 1);
+		return;
+	}
+	if (hint >= 0 && node_list[hint]->get_uninit_action() == act) {
+		ckpt->put(2 * hint + 2);
+		return;
+	}
+	for (unsigned int i = 0; i < node_list.size(); i++) {
+		if (node_list[i]->get_uninit_action() == act) {
+			ckpt->put(2 * i + 2);
+			return;
+		}
+	}
+	ASSERT(false);
+}
+
+/**
+ * @brief Read a reference written by save_action_ref()
+ * @return The ModelAction, or NULL (in which case the checkpoint may have
+ * failed)
+ */
+ModelAction * NodeStack::load_action_ref(Checkpoint *ckpt) const
+{
+	uint64_t ref = ckpt->get();
+	if (ref == 0)
+		return NULL;
+	ModelAction *act = ref_to_action(ref);
+	if (act == NULL)
+		ckpt->fail();
+	return act;
+}
+
+/** @return The ModelAction a (non-zero) reference refers to, or NULL if
+ * there is no such action */
+ModelAction * NodeStack::ref_to_action(uint64_t ref) const
+{
+	if (ref == 0 || (ref - 1) / 2 >= node_list.size())
+		return NULL;
+	Node *node = node_list[(ref - 1) / 2];
+	return (ref & 1) ? node->get_action() : node->get_uninit_action();
+}
+
+/**
+ * @brief Write the exploration frontier to a checkpoint
+ *
+ * The Nodes are written first, with their actions and thread choices, then
+ * the behaviors of each, which may refer to the actions of any Node.
+ */
+void NodeStack::save(Checkpoint *ckpt) const
+{
+	ckpt->put(total_nodes);
+	ckpt->put(node_list.size());
+	for (unsigned int i = 0; i < node_list.size(); i++) {
+		const Node *node = node_list[i];
+		const ModelAction *act = node->get_action();
+		ckpt->put(act->get_type());
+		ckpt->put(act->get_mo());
+		ckpt->put((uintptr_t)act->get_location());
+		ckpt->put(act->get_value());
+		ckpt->put(id_to_int(act->get_tid()));
+		const ModelAction *uninit = node->get_uninit_action();
+		ckpt->put((uintptr_t)(uninit ? uninit->get_location() : NULL));
+		ckpt->put(node->get_num_threads());
+		node->save_threads(ckpt);
+	}
+	for (unsigned int i = 0; i < node_list.size(); i++)
+		node_list[i]->save_behaviors(ckpt, this);
+}
+
+/**
+ * @brief Rebuild the Nodes written by save(), in this empty NodeStack
+ *
+ * The Nodes are rebuilt in order, so each one computes its fairness
+ * information just as it did when it was first explored. Their yield
+ * information is recomputed when they are replayed.
+ *
+ * @param ckpt The checkpoint
+ * @param model_thread The model-checker thread, with which the actions are
+ * created before they are given their own thread IDs
+ * @return False if the checkpoint is inconsistent
+ */
+bool NodeStack::load(Checkpoint *ckpt, Thread *model_thread)
+{
+	ASSERT(node_list.empty());
+	int saved_total_nodes = ckpt->get();
+	unsigned int num_nodes = ckpt->get();
+	while (node_list.size() < num_nodes && !ckpt->failed()) {
+		action_type_t type = (action_type_t)ckpt->get();
+		memory_order order = (memory_order)ckpt->get();
+		void *loc = (void *)(uintptr_t)ckpt->get();
+		uint64_t value = ckpt->get();
+		int tid = ckpt->get();
+		void *uninit_loc = (void *)(uintptr_t)ckpt->get();
+		int nthreads = ckpt->get();
+		if (ckpt->failed() || tid >= nthreads ||
+				(!loc && type != ATOMIC_FENCE && type != MODEL_FIXUP_RELSEQ)) {
+			ckpt->fail();
+			break;
+		}
+
+		ModelAction *act = new ModelAction(type, order, loc, value, model_thread);
+		act->set_tid(int_to_id(tid));
+		Node *node = push_node(act, nthreads);
+		if (uninit_loc)
+			node->set_uninit_action(new ModelAction(ATOMIC_UNINIT, std::memory_order_relaxed, uninit_loc, get_params()->uninitvalue, model_thread));
+		node->load_threads(ckpt);
+	}
+	for (unsigned int i = 0; i < node_list.size() && !ckpt->failed(); i++)
+		node_list[i]->load_behaviors(ckpt, this);
+
+	total_nodes = saved_total_nodes;
+	reset_execution();
+	return !ckpt->failed() && node_list.size() == num_nodes;
+}
+
+/**
+ * @brief Write the choice sequence of the current execution: the choices
+ * taken at each of its Nodes
+ */
+void NodeStack::save_choices(Checkpoint *ckpt) const
+{
+	ckpt->put(head_idx + 1);
+	for (int i = 0; i <= head_idx; i++)
+		node_list[i]->save_choices(ckpt, this);
+}
+
+/**
+ * @brief Read a choice sequence written by save_choices(), to be replayed
+ * by the next execution
+ * @return False if the sequence is inconsistent
+ */
+bool NodeStack::load_choices(Checkpoint *ckpt)
+{
+	unsigned int num_steps = ckpt->get();
+	for (unsigned int i = 0; i < num_steps && !ckpt->failed(); i++) {
+		struct replay_step step;
+		step.tid = int_to_id(ckpt->get());
+		step.read_from_status = (read_from_type_t)ckpt->get();
+		step.read_from = 0;
+		step.future_value.value = 0;
+		step.future_value.expiration = 0;
+		step.future_value.tid = THREAD_ID_T_NONE;
+		switch (step.read_from_status) {
+		case READ_FROM_PAST:
+		case READ_FROM_PROMISE:
+			step.read_from = ckpt->get();
+			break;
+		case READ_FROM_FUTURE:
+			step.future_value.value = ckpt->get();
+			step.future_value.expiration = ckpt->get();
+			step.future_value.tid = int_to_id(ckpt->get());
+			break;
+		case READ_FROM_NONE:
+			break;
+		default:
+			ckpt->fail();
+			break;
+		}
+		step.resolve_promise_idx = ckpt->get_signed();
+		step.relseq_break_index = ckpt->get_signed();
+		step.misc_index = ckpt->get_signed();
+		replay.push_back(step);
+	}
+	return !ckpt->failed();
+}
+
+/**
+ * @return The thread whose action the recorded choice sequence takes next, or
+ * THREAD_ID_T_NONE if not replaying
+ */
+thread_id_t NodeStack::get_replay_thread() const
+{
+	if (head_idx + 1 < (int)replay.size())
+		return replay[head_idx + 1].tid;
+	return THREAD_ID_T_NONE;
+}
+
+/**
+ * @brief Take the recorded choices for a newly-explored Node, if replaying
+ *
+ * If the execution no longer matches the recording, the rest of it is
+ * explored as usual.
+ *
+ * @param node The Node, whose behaviors are built
+ */
+void NodeStack::replay_choices(Node *node)
+{
+	int i = node->get_depth();
+	if (i >= (int)replay.size())
+		return;
+	const struct replay_step *step = &replay[i];
+	ModelAction *read_from = ref_to_action(step->read_from);
+	if (step->tid != node->get_action()->get_tid() ||
+			(step->read_from != 0 && read_from == NULL) ||
+			!node->set_choices(step, read_from)) {
+		model_print("Replay diverged from the recorded execution at step %d\n", i);
+		replay.clear();
+	}
+}
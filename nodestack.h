@@ -12,14 +12,56 @@
 #include "schedule.h"
 #include "promise.h"
 #include "stl-model.h"
+#include "threadset.h"
 
 class ModelAction;
 class Thread;
+class Checkpoint;
+class NodeStack;
 
+/** @brief A thread's activity within the fairness window */
 struct fairness_info {
 	unsigned int enabled_count;
 	unsigned int turns;
-	bool priority;
+};
+
+/** @brief A bitset row of yield bookkeeping, indexed by thread ID */
+struct yield_row {
+	unsigned int numwords;
+	uint64_t bits[1];
+};
+
+/** @return Word w of a yield row, which may be NULL (empty) */
+static inline uint64_t yield_row_word(const struct yield_row *row, unsigned int w)
+{
+	return (row && w < row->numwords) ? row->bits[w] : 0;
+}
+
+/**
+ * @brief A thread's CHESS-like yield bookkeeping
+ *
+ * Rather than keeping the pairwise yield states of every two threads u and v,
+ * each Node keeps a few steps (Node depths) per thread, from which:
+ *  - v has been enabled since u's last yield (E) iff
+ *    v.last_disabled < u.yield_step,
+ *  - v has run since u's last yield (S) iff v.last_run > u.yield_step,
+ *  - u disabled v since u's last yield (D) iff v.created > u.yield_step or v
+ *    is in u.disabled, and
+ *  - u yielded in favor of v (P) iff v is in u.priority and
+ *    v.last_run < u.yield_step.
+ * The rows are shared with the ancestor Node that built them, so each Node
+ * only builds the rows of the thread that takes its step.
+ */
+struct yield_info {
+	/** @brief The step of the thread's last yield, or -1 if none */
+	int yield_step;
+	int last_run;
+	int last_disabled;
+	int created;
+	/** @brief The threads this one disabled since its last yield */
+	const struct yield_row *disabled;
+	/** @brief The threads this one yielded in favor of, at its last yield */
+	const struct yield_row *priority;
 };
 
 /**
@@ -36,12 +78,53 @@ typedef enum {
 	READ_FROM_NONE, /**< @brief A NULL state, which should not be reached */
 } read_from_type_t;
 
-#define YIELD_E 1
-#define YIELD_D 2
-#define YIELD_S 4
-#define YIELD_P 8
-#define YIELD_INDEX(tid1, tid2, num_threads) (tid1*num_threads+tid2)
+/**
+ * @brief The choices taken at one step of a recorded execution
+ * @see Node::save_choices()
+ */
+struct replay_step {
+	thread_id_t tid;
+	read_from_type_t read_from_status;
+	/** @brief The action read from (for READ_FROM_PAST) or the reader of
+	 *  the promise read from (READ_FROM_PROMISE), as a reference into the
+	 *  NodeStack */
+	uint64_t read_from;
+	/** @brief The value read, for READ_FROM_FUTURE */
+	struct future_value future_value;
+	int resolve_promise_idx;
+	int relseq_break_index;
+	int misc_index;
+};
+
+/**
+ * @brief A stack-ordered allocator for Nodes
+ *
+ * Nodes (and the arrays sized when they are built) are allocated in
+ * ascending order from large chunks of non-snapshotting memory. Since the
+ * NodeStack only ever pops its most recent Nodes, freeing them is a matter of
+ * resetting the allocation pointer back to the first Node popped. Chunks are
+ * kept for reuse until the arena is destroyed.
+ */
+class NodeArena {
+public:
+	NodeArena();
+	~NodeArena();
+	void * allocate(size_t size);
+	void release(void *mark);
 
+	MEMALLOC
+private:
+	struct arena_chunk {
+		char *base;
+		size_t size;
+	};
+
+	ModelVector<struct arena_chunk> chunks;
+	/** @brief The index of the chunk being allocated from */
+	unsigned int curr;
+	/** @brief The next free byte in the current chunk */
+	char *top;
+};
 
 /**
  * @brief A single node in a NodeStack
@@ -49,13 +132,13 @@ typedef enum {
  * Represents a single node in the NodeStack. Each Node is associated with up
  * to one action and up to one parent node. A node holds information
  * regarding the last action performed (the "associated action"), the thread
- * choices that have been explored (explored_children) and should be explored
+ * choices that have been explored (explored) and should be explored
  * (backtrack), and the actions that the last action may read from.
  */
 class Node {
 public:
 	Node(const struct model_params *params, ModelAction *act, Node *par,
-			int nthreads, Node *prevfairness);
+			int nthreads, Node *prevfairness, NodeArena *arena);
 	~Node();
 	/* return true = thread choice has already been explored */
 	bool has_been_explored(thread_id_t tid) const;
@@ -63,10 +146,11 @@ public:
 	bool backtrack_empty() const;
 
 	void clear_backtracking();
-	void explore_child(ModelAction *act, enabled_type_t *is_enabled);
+	void explore_child(ModelAction *act, const Scheduler *scheduler);
 	/* return false = thread was already in backtrack */
 	bool set_backtrack(thread_id_t id);
 	thread_id_t get_next_backtrack();
+	int get_next_unexplored(int from) const;
 	bool is_enabled(Thread *t) const;
 	bool is_enabled(thread_id_t tid) const;
 	enabled_type_t enabled_status(thread_id_t tid) const;
@@ -76,9 +160,19 @@ public:
 	ModelAction * get_uninit_action() const { return uninit_action; }
 
 	bool has_priority(thread_id_t tid) const;
+	/** @return True if any of the given threads has fairness priority */
+	template<typename _Set>
+	bool has_priority_among(const _Set &threads) const {
+		return priority.next_common(0, threads) >= 0;
+	}
 	void update_yield(Scheduler *);
 	bool has_priority_over(thread_id_t tid, thread_id_t tid2) const;
+	template<typename _Set>
+	bool has_priority_over_any(thread_id_t tid, const _Set &threads) const;
 	int get_num_threads() const { return num_threads; }
+	/** @return The distance from the root Node, which is also this Node's
+	 * index in the NodeStack */
+	int get_depth() const { return depth; }
 	/** @return the parent Node to this Node; that is, the action that
 	 * occurred previously in the stack. */
 	Node * get_parent() const { return parent; }
@@ -108,7 +202,12 @@ public:
 	bool promise_empty() const;
 	void clear_promise_resolutions();
 
-	enabled_type_t *get_enabled_array() {return enabled_array;}
+	/** @return The threads enabled (including sleeping ones) when this
+	 * Node's child was explored */
+	const ModelThreadSet & get_enabled_set() const { return enabled; }
+	/** @return The threads enabled and not sleeping when this Node's child
+	 * was explored */
+	const ModelThreadSet & get_runnable_set() const { return runnable; }
 
 	void set_misc_max(int i);
 	int get_misc() const;
@@ -124,17 +223,24 @@ public:
 
 	void print() const;
 
+	void save_threads(Checkpoint *ckpt) const;
+	void load_threads(Checkpoint *ckpt);
+	void save_behaviors(Checkpoint *ckpt, const NodeStack *stack) const;
+	void load_behaviors(Checkpoint *ckpt, const NodeStack *stack);
+	void save_choices(Checkpoint *ckpt, const NodeStack *stack) const;
+	bool set_choices(const struct replay_step *step, const ModelAction *read_from);
+
 	MEMALLOC
 private:
 	void explore(thread_id_t tid);
-	int get_yield_data(int tid1, int tid2) const;
+	size_t yield_row_size() const;
+	struct yield_row * get_own_yield_row(int i) const;
 	bool read_from_past_empty() const;
 	bool increment_read_from_past();
 	bool read_from_promise_empty() const;
 	bool increment_read_from_promise();
 	bool future_value_empty() const;
 	bool increment_future_value();
-	read_from_type_t read_from_status;
 	const struct model_params * get_params() const { return params; }
 
 	ModelAction * const action;
@@ -146,34 +252,47 @@ private:
 
 	Node * const parent;
 	const int num_threads;
-	ModelVector<bool> explored_children;
-	ModelVector<bool> backtrack;
-	ModelVector<struct fairness_info> fairness;
-	int numBacktracks;
-	enabled_type_t *enabled_array;
+	read_from_type_t read_from_status;
+
+	/** @brief The thread choices explored from this Node */
+	ModelThreadSet explored;
+	/** @brief The thread choices still to be explored from this Node */
+	ModelThreadSet backtrack;
+	/** @brief The threads that were enabled (THREAD_ENABLED or
+	 * THREAD_SLEEP_SET) */
+	ModelThreadSet enabled;
+	/** @brief The threads that were THREAD_ENABLED */
+	ModelThreadSet runnable;
+
+	/** @brief The distance from the root Node */
+	const int depth;
+
+	/** @brief Per-thread fairness (only with a fairness window), allocated
+	 * along with this Node */
+	struct fairness_info *fairness;
+	/** @brief The threads with fairness priority */
+	ModelThreadSet priority;
+	/** @brief Per-thread yield bookkeeping (only with yield support),
+	 * allocated along with this Node and followed by the rows it builds */
+	struct yield_info *yield_data;
 
 	/**
 	 * The set of past ModelActions that this the action at this Node may
 	 * read from. Only meaningful if this Node represents a 'read' action.
 	 */
-	ModelVector<const ModelAction *> read_from_past;
-	unsigned int read_from_past_idx;
+	ModelSmallVector<const ModelAction *, 4> read_from_past;
+	ModelSmallVector<const ModelAction *, 1> read_from_promises;
+	ModelSmallVector<struct future_value, 1> future_values;
+	ModelSmallVector<bool, 8> resolve_promise;
+	ModelSmallVector<const ModelAction *, 1> relseq_break_writes;
 
-	ModelVector<const ModelAction *> read_from_promises;
+	unsigned int read_from_past_idx;
 	int read_from_promise_idx;
-
-	ModelVector<struct future_value> future_values;
 	int future_index;
-
-	ModelVector<bool> resolve_promise;
 	int resolve_promise_idx;
-
-	ModelVector<const ModelAction *> relseq_break_writes;
 	int relseq_break_index;
-
 	int misc_index;
 	int misc_max;
-	int * yield_data;
 };
 
 typedef ModelVector<Node *> node_list_t;
@@ -193,19 +312,38 @@ public:
 
 	void register_engine(const ModelExecution *exec);
 
-	ModelAction * explore_action(ModelAction *act, enabled_type_t * is_enabled);
+	ModelAction * explore_action(ModelAction *act, const Scheduler *scheduler);
 	Node * get_head() const;
 	Node * get_next() const;
 	void reset_execution();
 	void pop_restofstack(int numAhead);
 	int get_total_nodes() { return total_nodes; }
 
+	void save_action_ref(Checkpoint *ckpt, const ModelAction *act, int hint = -1) const;
+	ModelAction * load_action_ref(Checkpoint *ckpt) const;
+	void save(Checkpoint *ckpt) const;
+	bool load(Checkpoint *ckpt, Thread *model_thread);
+
+	void save_choices(Checkpoint *ckpt) const;
+	bool load_choices(Checkpoint *ckpt);
+	thread_id_t get_replay_thread() const;
+	void replay_choices(Node *node);
+
 	void print() const;
 
 	MEMALLOC
 private:
+	Node * push_node(ModelAction *act, int nthreads);
+	ModelAction * ref_to_action(uint64_t ref) const;
+
 	node_list_t node_list;
 
+	/** @brief The recorded choice sequence being replayed, if any */
+	ModelVector<struct replay_step> replay;
+
+	/** @brief The storage for the Nodes in node_list */
+	NodeArena arena;
+
 	const struct model_params * get_params() const;
 
 	/** @brief The model-checker execution object */
@@ -10,6 +10,8 @@ struct model_params {
 	int maxfuturedelay;
 	bool yieldon;
 	bool yieldblock;
+	bool spinblock;
+	bool symmetry;
 	unsigned int fairwindow;
 	unsigned int enabledcount;
 	unsigned int bound;
@@ -27,6 +29,26 @@ struct model_params {
 	/** @brief Verbosity (0 = quiet; 1 = noisy; 2 = noisier) */
 	int verbose;
 
+	/** @brief File of race suppressions to load, or NULL */
+	const char *suppressions;
+
+	/** @brief Collect and print race detector statistics */
+	bool racestats;
+
+	/** @brief File to save the exploration to, and resume it from, or
+	 *  NULL */
+	const char *checkpoint;
+
+	/** @brief Minimum number of seconds between checkpoints */
+	unsigned int checkpointinterval;
+
+	/** @brief Prefix of the files to save the choices of buggy executions
+	 *  to, or NULL */
+	const char *record;
+
+	/** @brief File of recorded choices to replay, or NULL */
+	const char *replay;
+
 	/** @brief Command-line argument count to pass to user program */
 	int argc;
 
@@ -121,12 +121,15 @@ void SCAnalysis::update_stats() {
 void SCAnalysis::check_rf(action_list_t *list) {
 	for (action_list_t::iterator it = list->begin(); it != list->end(); it++) {
 		const ModelAction *act = *it;
+		unsigned int loc_id = act->get_loc_id();
+		if (loc_id >= lastwrmap.size())
+			lastwrmap.resize(loc_id + 1);
 		if (act->is_read()) {
-			if (act->get_reads_from() != lastwrmap.get(act->get_location()))
-				badrfset.put(act, lastwrmap.get(act->get_location()));
+			if (act->get_reads_from() != lastwrmap[loc_id])
+				badrfset.put(act, lastwrmap[loc_id]);
 		}
 		if (act->is_write())
-			lastwrmap.put(act->get_location(), act);
+			lastwrmap[loc_id] = act;
 	}
 }
 
@@ -335,8 +338,8 @@ void SCAnalysis::reset(action_list_t *list) {
 	for (action_list_t::iterator it = list->begin(); it != list->end(); it++) {
 		ModelAction *act = *it;
 		delete cvmap.get(act);
-		cvmap.put(act, NULL);
 	}
+	cvmap.reset();
 
 	cyclic=false;	
 }
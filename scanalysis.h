@@ -1,7 +1,7 @@
 #ifndef SCANALYSIS_H
 #define SCANALYSIS_H
 #include "traceanalysis.h"
-#include "hashtable.h"
+#include "actionmap.h"
 
 struct sc_statistics {
 	unsigned long long elapsedtime;
@@ -36,10 +36,11 @@ class SCAnalysis : public TraceAnalysis {
 	ModelAction* pruneArray(ModelAction**, int);
 
 	int maxthreads;
-	HashTable<const ModelAction *, ClockVector *, uintptr_t, 4 > cvmap;
+	ActionMap<ClockVector *> cvmap;
 	bool cyclic;
-	HashTable<const ModelAction *, const ModelAction *, uintptr_t, 4 > badrfset;
-	HashTable<void *, const ModelAction *, uintptr_t, 4 > lastwrmap;
+	ActionMap<const ModelAction *> badrfset;
+	/** @brief The last write to each location, indexed by location ID */
+	SnapVector<const ModelAction *> lastwrmap;
 	SnapVector<action_list_t> threadlists;
 	ModelExecution *execution;
 	bool print_always;
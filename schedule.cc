@@ -37,7 +37,8 @@ void enabled_type_to_string(enabled_type_t e, char *str)
 /** Constructor */
 Scheduler::Scheduler() :
 	execution(NULL),
-	enabled(NULL),
+	enabled(),
+	runnable(),
 	enabled_len(0),
 	curr_thread_index(0),
 	current(NULL)
@@ -55,17 +56,16 @@ void Scheduler::register_engine(ModelExecution *execution)
 
 void Scheduler::set_enabled(Thread *t, enabled_type_t enabled_status) {
 	int threadid = id_to_int(t->get_id());
-	if (threadid >= enabled_len) {
-		enabled_type_t *new_enabled = (enabled_type_t *)snapshot_malloc(sizeof(enabled_type_t) * (threadid + 1));
-		memset(&new_enabled[enabled_len], 0, (threadid + 1 - enabled_len) * sizeof(enabled_type_t));
-		if (enabled != NULL) {
-			memcpy(new_enabled, enabled, enabled_len * sizeof(enabled_type_t));
-			snapshot_free(enabled);
-		}
-		enabled = new_enabled;
+	if (threadid >= enabled_len)
 		enabled_len = threadid + 1;
-	}
-	enabled[threadid] = enabled_status;
+	if (enabled_status == THREAD_DISABLED)
+		enabled.remove(threadid);
+	else
+		enabled.add(threadid);
+	if (enabled_status == THREAD_ENABLED)
+		runnable.add(threadid);
+	else
+		runnable.remove(threadid);
 	if (enabled_status == THREAD_DISABLED)
 		execution->check_promises_thread_disabled();
 }
@@ -93,8 +93,7 @@ bool Scheduler::is_enabled(const Thread *t) const
  */
 bool Scheduler::is_enabled(thread_id_t tid) const
 {
-	int i = id_to_int(tid);
-	return (i >= enabled_len) ? false : (enabled[i] != THREAD_DISABLED);
+	return enabled.contains(id_to_int(tid));
 }
 
 /**
@@ -115,28 +114,31 @@ bool Scheduler::is_sleep_set(const Thread *t) const
  */
 bool Scheduler::all_threads_sleeping() const
 {
-	bool sleeping = false;
-	for (int i = 0; i < enabled_len; i++)
-		if (enabled[i] == THREAD_ENABLED)
-			return false;
-		else if (enabled[i] == THREAD_SLEEP_SET)
-			sleeping = true;
-	return sleeping;
+	/* The sleeping threads are the enabled ones that are not runnable */
+	return runnable.empty() && !enabled.empty();
 }
 
 enabled_type_t Scheduler::get_enabled(const Thread *t) const
 {
 	int id = id_to_int(t->get_id());
 	ASSERT(id < enabled_len);
-	return enabled[id];
+	if (runnable.contains(id))
+		return THREAD_ENABLED;
+	return enabled.contains(id) ? THREAD_SLEEP_SET : THREAD_DISABLED;
 }
 
+/**
+ * Puts the threads in the sleep set of a Node into the sleep set
+ * @param n The Node whose sleep set to add
+ */
 void Scheduler::update_sleep_set(Node *n) {
-	enabled_type_t *enabled_array = n->get_enabled_array();
-	for (int i = 0; i < enabled_len; i++) {
-		if (enabled_array[i] == THREAD_SLEEP_SET) {
-			enabled[i] = THREAD_SLEEP_SET;
-		}
+	const ModelThreadSet &node_enabled = n->get_enabled_set();
+	const ModelThreadSet &node_runnable = n->get_runnable_set();
+	for (int i = node_enabled.next_excluding(0, node_runnable);
+			i >= 0 && i < enabled_len;
+			i = node_enabled.next_excluding(i + 1, node_runnable)) {
+		enabled.add(i);
+		runnable.remove(i);
 	}
 }
 
@@ -214,42 +216,31 @@ void Scheduler::wake(Thread *t)
  */
 Thread * Scheduler::select_next_thread(Node *n)
 {
-	int old_curr_thread = curr_thread_index;
+	if (enabled_len == 0)
+		return NULL;
 
 	bool have_enabled_thread_with_priority = false;
-	if (model->params.fairwindow != 0) {
-		for (int i = 0; i < enabled_len; i++) {
-			thread_id_t tid = int_to_id(i);
-			if (n->has_priority(tid)) {
-				DEBUG("Node (tid %d) has priority\n", i);
-				if (enabled[i] != THREAD_DISABLED)
-					have_enabled_thread_with_priority = true;
-			}
-		}
-	}	
+	if (model->params.fairwindow != 0)
+		have_enabled_thread_with_priority = n->has_priority_among(enabled);
 
-	for (int i = 0; i < enabled_len; i++) {
-		curr_thread_index = (old_curr_thread + i + 1) % enabled_len;
-		thread_id_t curr_tid = int_to_id(curr_thread_index);
-		if (model->params.yieldon) {
-			bool bad_thread = false;
-			for (int j = 0; j < enabled_len; j++) {
-				thread_id_t tother = int_to_id(j);
-				if ((enabled[j] != THREAD_DISABLED) && n->has_priority_over(curr_tid, tother)) {
-					bad_thread=true;
-					break;
-				}
-			}
-			if (bad_thread)
+	/* Round-robin over the runnable threads, starting after the last
+	 * thread selected */
+	int start = (curr_thread_index + 1) % enabled_len;
+	for (int pass = 0; pass < 2; pass++) {
+		int end = pass == 0 ? enabled_len : start;
+		for (int i = runnable.next(pass == 0 ? start : 0); i >= 0 && i < end; i = runnable.next(i + 1)) {
+			thread_id_t curr_tid = int_to_id(i);
+			/* Skip threads that yielded to an enabled thread */
+			if (model->params.yieldon && n->has_priority_over_any(curr_tid, enabled))
 				continue;
-		}
-		
-		if (enabled[curr_thread_index] == THREAD_ENABLED &&
-				(!have_enabled_thread_with_priority || n->has_priority(curr_tid))) {
-			return model->get_thread(curr_tid);
+
+			if (!have_enabled_thread_with_priority || n->has_priority(curr_tid)) {
+				curr_thread_index = i;
+				return model->get_thread(curr_tid);
+			}
 		}
 	}
-	
+
 	/* No thread was enabled */
 	return NULL;
 }
@@ -291,7 +282,8 @@ void Scheduler::print() const
 	model_print("Scheduler: ");
 	for (int i = 0; i < enabled_len; i++) {
 		char str[20];
-		enabled_type_to_string(enabled[i], str);
+		enabled_type_to_string(runnable.contains(i) ? THREAD_ENABLED :
+				enabled.contains(i) ? THREAD_SLEEP_SET : THREAD_DISABLED, str);
 		model_print("[%i: %s%s]", i, i == curr_id ? "current, " : "", str);
 	}
 	model_print("\n");
@@ -7,6 +7,7 @@
 
 #include "mymemory.h"
 #include "modeltypes.h"
+#include "threadset.h"
 
 /* Forward declaration */
 class Thread;
@@ -36,7 +37,11 @@ public:
 	void set_current_thread(Thread *t);
 	Thread * get_current_thread() const;
 	void print() const;
-	enabled_type_t * get_enabled_array() const { return enabled; };
+	/** @return The threads that are enabled, including sleeping ones */
+	const ThreadSet<> & get_enabled_set() const { return enabled; }
+	/** @return The threads that are enabled and not sleeping */
+	const ThreadSet<> & get_runnable_set() const { return runnable; }
+	int get_num_threads() const { return enabled_len; }
 	void remove_sleep(Thread *t);
 	void add_sleep(Thread *t);
 	enabled_type_t get_enabled(const Thread *t) const;
@@ -50,8 +55,11 @@ public:
 	SNAPSHOTALLOC
 private:
 	ModelExecution *execution;
-	/** The list of available Threads that are not currently running */
-	enabled_type_t *enabled;
+	/** The Threads that are enabled (THREAD_ENABLED or THREAD_SLEEP_SET) */
+	ThreadSet<> enabled;
+	/** The Threads that are THREAD_ENABLED (and so not in the sleep set) */
+	ThreadSet<> runnable;
+	/** One more than the highest thread ID the scheduler has seen */
 	int enabled_len;
 	int curr_thread_index;
 	void set_enabled(Thread *t, enabled_type_t enabled_status);
@@ -100,12 +100,26 @@ mprot_snapshotter::~mprot_snapshotter()
 	model_free(snapShots);
 }
 
+/** @return Whether addr is in one of the snapshotted memory regions */
+static bool mprot_is_snapshotted(void *addr)
+{
+	for (unsigned int region = 0; region < mprot_snap->lastRegion; region++) {
+		char *base = (char *)mprot_snap->regionsToSnapShot[region].basePtr;
+		if ((char *)addr >= base && (char *)addr < base + mprot_snap->regionsToSnapShot[region].sizeInPages * PAGESIZE)
+			return true;
+	}
+	return false;
+}
+
 /** mprot_handle_pf is the page fault handler for mprotect based snapshotting
  * algorithm.
  */
 static void mprot_handle_pf(int sig, siginfo_t *si, void *unused)
 {
-	if (si->si_code == SEGV_MAPERR) {
+	if (si->si_code == SEGV_MAPERR ||
+			(si->si_code == SEGV_ACCERR && !mprot_is_snapshotted(si->si_addr))) {
+		/* Also catches protected pages that are not ours, such as
+		 * the guard pages below thread stacks */
 		model_print("Segmentation fault at %p\n", si->si_addr);
 		model_print("For debugging, place breakpoint at: %s:%d\n",
 				__FILE__, __LINE__);
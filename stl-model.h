@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <list>
+#include <string.h>
 #include "mymemory.h"
 
 template<typename _Tp>
@@ -73,4 +74,67 @@ class SnapVector : public std::vector<_Tp, SnapshotAlloc<_Tp> >
 	SNAPSHOTALLOC
 };
 
+/**
+ * @brief A vector with inline storage for its first few elements
+ *
+ * Holds up to _N elements without allocating; beyond that, the elements move
+ * to the non-snapshotting heap. Only for types that can be copied with
+ * memcpy() and need no destructor.
+ */
+template<typename _Tp, unsigned int _N>
+class ModelSmallVector
+{
+ public:
+	ModelSmallVector() :
+		elems(inline_elems),
+		len(0),
+		cap(_N)
+	{ }
+
+	~ModelSmallVector() {
+		if (elems != inline_elems)
+			model_free(elems);
+	}
+
+	unsigned int size() const { return len; }
+	bool empty() const { return len == 0; }
+	void clear() { len = 0; }
+
+	_Tp & operator[](unsigned int i) { return elems[i]; }
+	const _Tp & operator[](unsigned int i) const { return elems[i]; }
+
+	void push_back(const _Tp &val) {
+		if (len == cap)
+			reserve(cap * 2);
+		elems[len++] = val;
+	}
+
+	void resize(unsigned int n, const _Tp &val = _Tp()) {
+		if (n > cap)
+			reserve(n > cap * 2 ? n : cap * 2);
+		for (unsigned int i = len; i < n; i++)
+			elems[i] = val;
+		len = n;
+	}
+
+	MEMALLOC
+ private:
+	ModelSmallVector(const ModelSmallVector &);
+	ModelSmallVector & operator=(const ModelSmallVector &);
+
+	void reserve(unsigned int n) {
+		_Tp *newelems = (_Tp *)model_malloc(n * sizeof(_Tp));
+		memcpy(newelems, elems, len * sizeof(_Tp));
+		if (elems != inline_elems)
+			model_free(elems);
+		elems = newelems;
+		cap = n;
+	}
+
+	_Tp *elems;
+	unsigned int len;
+	unsigned int cap;
+	_Tp inline_elems[_N];
+};
+
 #endif /* __STL_MODEL_H__ */
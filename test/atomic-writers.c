@@ -0,0 +1,52 @@
+/**
+ * @file atomic-writers.c
+ * @brief A non-atomic read racing with the first of two atomic writes
+ *
+ * Threads a and b write x atomically, concurrently; c synchronizes with b
+ * after its write, then reads x non-atomically. The read happens after b's
+ * write, but it still races with a's.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <threads.h>
+#include <stdatomic.h>
+
+#include "librace.h"
+
+atomic_int x;
+atomic_int flag;
+
+static void a(void *obj)
+{
+	atomic_store_explicit(&x, 1, memory_order_relaxed);
+}
+
+static void b(void *obj)
+{
+	atomic_store_explicit(&x, 2, memory_order_relaxed);
+	atomic_store_explicit(&flag, 1, memory_order_release);
+}
+
+static void c(void *obj)
+{
+	if (atomic_load_explicit(&flag, memory_order_acquire))
+		printf("x = %u\n", load_32(&x));
+}
+
+int user_main(int argc, char **argv)
+{
+	thrd_t t1, t2, t3;
+
+	atomic_init(&x, 0);
+	atomic_init(&flag, 0);
+
+	thrd_create(&t1, (thrd_start_t)&a, NULL);
+	thrd_create(&t2, (thrd_start_t)&b, NULL);
+	thrd_create(&t3, (thrd_start_t)&c, NULL);
+
+	thrd_join(t1);
+	thrd_join(t2);
+	thrd_join(t3);
+
+	return 0;
+}
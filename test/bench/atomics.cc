@@ -0,0 +1,39 @@
+/**
+ * @file atomics.cc
+ * @brief Microbenchmark for the cost of an atomic operation
+ *
+ * Every atomic operation is a round trip from the user thread to the model
+ * checker and back. Runs a single thread's worth of relaxed stores and loads
+ * (so only one execution is explored), each to its own location so that the
+ * model checker's per-location work stays constant, and reports on stderr
+ * the throughput in atomic operations per second.
+ */
+#include <stdio.h>
+#include <time.h>
+#include <threads.h>
+#include <atomic>
+
+#define NUM_OPS (1 << 14)
+
+static std::atomic<int> locs[NUM_OPS / 2];
+
+static double now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int user_main(int argc, char **argv)
+{
+	double start = now_ns();
+	for (int i = 0; i < NUM_OPS / 2; i++) {
+		locs[i].store(i, std::memory_order_relaxed);
+		locs[i].load(std::memory_order_relaxed);
+	}
+	double elapsed = now_ns() - start;
+
+	fprintf(stderr, "%d atomic ops: %7.2f us/op, %.0f ops/s\n",
+			NUM_OPS, elapsed / NUM_OPS / 1e3, NUM_OPS / (elapsed / 1e9));
+	return 0;
+}
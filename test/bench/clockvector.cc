@@ -0,0 +1,134 @@
+/**
+ * @file clockvector.cc
+ * @brief Microbenchmark for the ClockVector merge and compare kernels
+ *
+ * Runs entirely inside user_main (i.e., within a single model-checker
+ * execution) and reports on stderr:
+ *  - the average cost of ClockVector::merge and ClockVector::dominates for 2,
+ *    8, 32 and 128 threads
+ *  - the average cost of a synchronizing ClockVector::merge in a simulated
+ *    message-passing workload with 16, 32 and 64 threads
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <threads.h>
+
+#include "action.h"
+#include "clockvector.h"
+#include "threads-model.h"
+
+#define NUM_VECTORS 64
+#define NUM_OPS (1 << 20)
+#define NUM_STEPS (1 << 17)
+
+static double now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int loc;
+
+static Thread ** make_threads(int nthreads)
+{
+	Thread **threads = (Thread **)malloc(nthreads * sizeof(*threads));
+	for (int t = 0; t < nthreads; t++)
+		threads[t] = new Thread(int_to_id(t));
+	return threads;
+}
+
+/** @brief Build NUM_VECTORS clock vectors of length nthreads with random clocks */
+static void build_vectors(ClockVector **cvs, int nthreads)
+{
+	Thread **threads = make_threads(nthreads);
+
+	for (int i = 0; i < NUM_VECTORS; i++) {
+		ClockVector *cv = NULL;
+		for (int t = 0; t < nthreads; t++) {
+			ModelAction *act = new ModelAction(ATOMIC_READ, std::memory_order_relaxed, &loc, 0, threads[t]);
+			act->set_seq_number(1 + rand() % 100000);
+			ClockVector *next = new ClockVector(cv, act);
+			delete act;
+			if (cv)
+				delete cv;
+			cv = next;
+		}
+		cvs[i] = cv;
+	}
+}
+
+static void bench(int nthreads)
+{
+	ClockVector *cvs[NUM_VECTORS];
+	volatile int sink = 0;
+	build_vectors(cvs, nthreads);
+
+	double start = now_ns();
+	for (int i = 0; i < NUM_OPS; i++)
+		sink += cvs[i % NUM_VECTORS]->dominates(cvs[(i * 7 + 3) % NUM_VECTORS]);
+	double dominates_ns = (now_ns() - start) / NUM_OPS;
+
+	start = now_ns();
+	for (int i = 0; i < NUM_OPS; i++)
+		sink += cvs[i % NUM_VECTORS]->merge(cvs[(i * 7 + 3) % NUM_VECTORS]);
+	double merge_ns = (now_ns() - start) / NUM_OPS;
+
+	fprintf(stderr, "%4d threads: merge %7.2f ns/op, dominates %7.2f ns/op\n",
+			nthreads, merge_ns, dominates_ns);
+}
+
+/**
+ * @brief Simulate message passing between nthreads threads
+ *
+ * Each step, a random thread takes a step (creating a new clock vector from
+ * its previous one), and half the time it acquires from the latest action of
+ * another random thread. Sender choice is skewed toward nearby threads, so
+ * most merges only carry a few new clocks.
+ */
+static void bench_sync(int nthreads)
+{
+	Thread **threads = make_threads(nthreads);
+	ClockVector **last = (ClockVector **)calloc(nthreads, sizeof(*last));
+	modelclock_t seq = 0;
+	double merge_ns = 0;
+	int merges = 0;
+
+	double begin = now_ns();
+	for (int i = 0; i < NUM_STEPS; i++) {
+		int t = rand() % nthreads;
+		ModelAction *act = new ModelAction(ATOMIC_READ, std::memory_order_acquire, &loc, 0, threads[t]);
+		act->set_seq_number(++seq);
+		ClockVector *cv = new ClockVector(last[t], act);
+		delete act;
+		if (last[t])
+			delete last[t];
+		last[t] = cv;
+
+		int u = (t + 1 + rand() % 4) % nthreads;
+		if ((rand() & 1) && last[u]) {
+			double start = now_ns();
+			cv->merge(last[u]);
+			merge_ns += now_ns() - start;
+			merges++;
+		}
+	}
+
+	double step_ns = (now_ns() - begin) / NUM_STEPS;
+
+	fprintf(stderr, "%4d threads: merge %7.2f ns/op, step %7.2f ns/op (simulated message passing)\n",
+			nthreads, merge_ns / merges, step_ns);
+}
+
+int user_main(int argc, char **argv)
+{
+	static const int sizes[] = { 2, 8, 32, 128 };
+	for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		bench(sizes[i]);
+
+	static const int sync_sizes[] = { 16, 32, 64 };
+	for (unsigned int i = 0; i < sizeof(sync_sizes) / sizeof(sync_sizes[0]); i++)
+		bench_sync(sync_sizes[i]);
+	return 0;
+}
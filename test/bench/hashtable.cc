@@ -0,0 +1,178 @@
+/**
+ * @file hashtable.cc
+ * @brief Microbenchmark for HashTable
+ *
+ * Compares HashTable against the plain linear-probing table it replaced
+ * (reproduced below as LinearTable), and reports on stderr the average cost
+ * of put, get (hits and misses) and reset for a few key distributions:
+ *  - "dense": consecutive objects, as from a bump allocator
+ *  - "strided": objects spaced 256 bytes apart, which the old identity hash
+ *    piles up into long runs
+ *  - "random": scattered addresses
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <threads.h>
+
+#include "hashtable.h"
+
+#define NUM_KEYS (1 << 16)
+#define NUM_LOOKUPS (1 << 20)
+#define NUM_RESETS (1 << 14)
+
+/** @brief The previous HashTable design: identity hash, linear probing */
+template<typename _Key, typename _Val, typename _KeyInt, int _Shift = 0>
+class LinearTable {
+ public:
+	LinearTable(unsigned int initialcapacity = 1024, double factor = 0.5) {
+		table = (struct hashlistnode<_Key, _Val> *)model_calloc(initialcapacity, sizeof(struct hashlistnode<_Key, _Val>));
+		loadfactor = factor;
+		capacity = initialcapacity;
+		capacitymask = initialcapacity - 1;
+		threshold = (unsigned int)(initialcapacity * loadfactor);
+		size = 0;
+	}
+
+	~LinearTable() {
+		model_free(table);
+	}
+
+	void reset() {
+		memset(table, 0, capacity * sizeof(struct hashlistnode<_Key, _Val>));
+		size = 0;
+	}
+
+	void put(_Key key, _Val val) {
+		if (size > threshold)
+			resize(capacity << 1);
+		struct hashlistnode<_Key, _Val> *search;
+		unsigned int index = ((_KeyInt)key) >> _Shift;
+		do {
+			index &= capacitymask;
+			search = &table[index];
+			if (search->key == key) {
+				search->val = val;
+				return;
+			}
+			index++;
+		} while (search->key);
+		search->key = key;
+		search->val = val;
+		size++;
+	}
+
+	_Val get(_Key key) const {
+		struct hashlistnode<_Key, _Val> *search;
+		unsigned int index = ((_KeyInt)key) >> _Shift;
+		do {
+			index &= capacitymask;
+			search = &table[index];
+			if (search->key == key)
+				return search->val;
+			index++;
+		} while (search->key);
+		return (_Val)0;
+	}
+
+	void resize(unsigned int newsize) {
+		struct hashlistnode<_Key, _Val> *oldtable = table;
+		unsigned int oldcapacity = capacity;
+		table = (struct hashlistnode<_Key, _Val> *)model_calloc(newsize, sizeof(struct hashlistnode<_Key, _Val>));
+		capacity = newsize;
+		capacitymask = newsize - 1;
+		threshold = (unsigned int)(newsize * loadfactor);
+		size = 0;
+		for (unsigned int i = 0; i < oldcapacity; i++)
+			if (oldtable[i].key)
+				put(oldtable[i].key, oldtable[i].val);
+		model_free(oldtable);
+	}
+
+ private:
+	struct hashlistnode<_Key, _Val> *table;
+	unsigned int capacity;
+	unsigned int size;
+	unsigned int capacitymask;
+	unsigned int threshold;
+	double loadfactor;
+};
+
+static double now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void make_keys(uintptr_t *keys, uintptr_t *misses, const char *dist)
+{
+	for (int i = 0; i < NUM_KEYS; i++) {
+		uintptr_t k;
+		if (dist[0] == 'd')
+			k = 0x10000000 + 16 * (uintptr_t)(2 * i);
+		else if (dist[0] == 's')
+			k = 0x10000000 + 256 * (uintptr_t)(2 * i);
+		else
+			k = ((((uintptr_t)rand() << 16) ^ rand()) << 4) | 0x10;
+		keys[i] = k;
+		/* Misses: interleaved with (or near) the hits */
+		misses[i] = dist[0] == 'r' ? k + 0x8 : k + (dist[0] == 'd' ? 16 : 256);
+	}
+}
+
+template<typename Table>
+static void bench_table(const char *name, const char *dist, uintptr_t *keys, uintptr_t *misses)
+{
+	volatile uintptr_t sink = 0;
+	Table *table = new Table(16);
+
+	double start = now_ns();
+	for (int i = 0; i < NUM_KEYS; i++)
+		table->put((const void *)keys[i], keys[i]);
+	double put_ns = (now_ns() - start) / NUM_KEYS;
+
+	start = now_ns();
+	for (int i = 0; i < NUM_LOOKUPS; i++)
+		sink += table->get((const void *)keys[((unsigned int)i * 7919) % NUM_KEYS]);
+	double hit_ns = (now_ns() - start) / NUM_LOOKUPS;
+
+	start = now_ns();
+	for (int i = 0; i < NUM_LOOKUPS; i++)
+		sink += table->get((const void *)misses[((unsigned int)i * 7919) % NUM_KEYS]);
+	double miss_ns = (now_ns() - start) / NUM_LOOKUPS;
+
+	/* CycleGraph-style use: a large table reset between small searches */
+	start = now_ns();
+	for (int i = 0; i < NUM_RESETS; i++) {
+		table->reset();
+		for (int j = 0; j < 8; j++)
+			table->put((const void *)keys[(i * 8 + j) % NUM_KEYS], 1);
+	}
+	double reset_ns = (now_ns() - start) / NUM_RESETS;
+
+	fprintf(stderr, "%-8s %-8s put %7.2f ns, get hit %7.2f ns, get miss %7.2f ns, reset+8 puts %9.2f ns\n",
+			name, dist, put_ns, hit_ns, miss_ns, reset_ns);
+	delete table;
+}
+
+typedef HashTable<const void *, uintptr_t, uintptr_t, 4, model_malloc, model_calloc, model_free> RobinHoodTable;
+typedef LinearTable<const void *, uintptr_t, uintptr_t, 4> OldTable;
+
+int user_main(int argc, char **argv)
+{
+	static const char *dists[] = { "dense", "strided", "random" };
+	uintptr_t *keys = (uintptr_t *)model_malloc(NUM_KEYS * sizeof(*keys));
+	uintptr_t *misses = (uintptr_t *)model_malloc(NUM_KEYS * sizeof(*misses));
+
+	for (unsigned int i = 0; i < sizeof(dists) / sizeof(dists[0]); i++) {
+		make_keys(keys, misses, dists[i]);
+		bench_table<OldTable>("linear", dists[i], keys, misses);
+		bench_table<RobinHoodTable>("robinhood", dists[i], keys, misses);
+	}
+
+	model_free(keys);
+	model_free(misses);
+	return 0;
+}
@@ -0,0 +1,105 @@
+; Accesses in a block are merged and checked in one batch per segment
+%struct.pair = type { i32, i32 }
+
+@p = global %struct.pair zeroinitializer
+@q = global i64 0
+@table = constant [4 x i32] [i32 1, i32 2, i32 3, i32 4]
+
+declare void @sync()
+declare void @escape(i32*)
+declare void @llvm.memcpy.p0i8.p0i8.i64(i8*, i8*, i64, i1)
+
+; Adjacent stores to the two fields become one 8-byte write
+; CHECK-LABEL: define void @fields(
+; CHECK: %race.batch = alloca { i8*, i64, i8* }, align 8
+; CHECK: store i32 2,
+; CHECK-NEXT: [[TID:%[0-9]+]] = call i32 @race_thread_id()
+; CHECK: store i8* bitcast (%struct.pair* @p to i8*)
+; CHECK: store i64 17,
+; CHECK-NEXT: {{.*}} = getelementptr
+; CHECK-NEXT: store i8* blockaddress(@fields, %race.site{{[0-9]*}}),
+; CHECK-NEXT: call void @race_check_batch(i32 [[TID]], { i8*, i64, i8* }* %race.batch, i32 1)
+; CHECK-NEXT: ret void
+define void @fields() {
+  store i32 1, i32* getelementptr (%struct.pair, %struct.pair* @p, i32 0, i32 0)
+  store i32 2, i32* getelementptr (%struct.pair, %struct.pair* @p, i32 0, i32 1)
+  ret void
+}
+
+; Calls end a segment; the thread id is fetched once per block, and a read
+; covered by a write in the same segment is dropped
+; CHECK-LABEL: define i64 @segments(
+; CHECK: [[TID:%[0-9]+]] = call i32 @race_thread_id()
+; CHECK: store i64 16,
+; CHECK-NEXT: {{.*}} = getelementptr
+; CHECK-NEXT: store i8* blockaddress(@segments, %race.site{{[0-9]*}}),
+; CHECK-NEXT: call void @race_check_batch(i32 [[TID]], { i8*, i64, i8* }* %race.batch, i32 1)
+; CHECK-NEXT: call void @sync()
+; CHECK-NOT: @race_thread_id
+; CHECK: store i64 17,
+; CHECK-NEXT: {{.*}} = getelementptr
+; CHECK-NEXT: store i8* blockaddress(@segments, %race.site{{[0-9]*}}),
+; CHECK-NEXT: call void @race_check_batch(i32 [[TID]], { i8*, i64, i8* }* %race.batch, i32 1)
+define i64 @segments() {
+  %a = load i64, i64* @q
+  call void @sync()
+  store i64 %a, i64* @q
+  %b = load i64, i64* @q
+  ret i64 %b
+}
+
+; Non-escaping stack slots, constants and atomics are not checked
+; CHECK-LABEL: define i32 @skipped(
+; CHECK: [[SHARED:%[0-9]+]] = bitcast i32* %shared to i8*
+; CHECK: store i8* [[SHARED]],
+; CHECK: store i64 9,
+; CHECK-NEXT: {{.*}} = getelementptr
+; CHECK-NEXT: store i8* blockaddress(@skipped, %race.site{{[0-9]*}}),
+; CHECK-NEXT: call void @race_check_batch({{.*}}, i32 1)
+; CHECK-NEXT: call void @escape
+; CHECK-NOT: @race_check_batch
+; CHECK: ret i32
+define i32 @skipped(i32 %i) {
+  %local = alloca i32
+  %shared = alloca i32
+  store i32 %i, i32* %local
+  store i32 %i, i32* %shared
+  call void @escape(i32* %shared)
+  %c = getelementptr [4 x i32], [4 x i32]* @table, i32 0, i32 %i
+  %v = load i32, i32* %c
+  %x = load atomic i32, i32* getelementptr (%struct.pair, %struct.pair* @p, i32 0, i32 0) acquire, align 4
+  %l = load i32, i32* %local
+  %s = add i32 %v, %x
+  %r = add i32 %s, %l
+  ret i32 %r
+}
+
+; Each entry names its own access, by the address of a block starting there
+; CHECK-LABEL: define i64 @sites(
+; CHECK: [[FIRST:race.site[0-9]*]]:
+; CHECK-NEXT: %a = load i64, i64* @q
+; CHECK: [[SECOND:race.site[0-9]*]]:
+; CHECK-NEXT: store i32 1,
+; CHECK: store i8* blockaddress(@sites, %[[FIRST]]),
+; CHECK: store i8* blockaddress(@sites, %[[SECOND]]),
+; CHECK: call void @race_check_batch({{.*}}, i32 2)
+define i64 @sites() {
+  %a = load i64, i64* @q
+  store i32 1, i32* getelementptr (%struct.pair, %struct.pair* @p, i32 0, i32 0)
+  ret i64 %a
+}
+
+; Memory intrinsics are checked as ranges
+; CHECK-LABEL: define void @copy(
+; CHECK: %race.batch = alloca { i8*, i64, i8* }, i32 2
+; CHECK: [[RD:%[0-9]+]] = shl i64 %n, 1
+; CHECK: store i8* %src,
+; CHECK: store i64 [[RD]],
+; CHECK: [[WR:%[0-9]+]] = or i64 {{%[0-9]+}}, 1
+; CHECK: store i8* %dst,
+; CHECK: store i64 [[WR]],
+; CHECK: call void @race_check_batch({{.*}}, i32 2)
+define void @copy(i8* %dst, i8* %src, i64 %n) {
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* %dst, i8* %src, i64 %n, i1 false)
+  ret void
+}
@@ -0,0 +1,63 @@
+; A complete program, run under the model-checker once instrumented:
+;
+;   struct pair { int a, b; } p;
+;   long x;
+;   void a(void *obj) { p.a = 1; p.b = 2; x = 1; }
+;   void b(void *obj) { x = 2; }
+;   int user_main(int argc, char **argv) {
+;       thrd_t t1, t2;
+;       thrd_create(&t1, a, NULL); thrd_create(&t2, b, NULL);
+;       thrd_join(t1); thrd_join(t2);
+;       return p.a + p.b;
+;   }
+;
+; The writes to x race; the reads of p after the joins do not.
+%struct.pair = type { i32, i32 }
+
+@p = global %struct.pair zeroinitializer
+@x = global i64 0
+
+declare i32 @thrd_create(i8**, void (i8*)*, i8*)
+declare i32 @thrd_join(i8*)
+
+; CHECK-LABEL: define void @a(
+; CHECK: store i64 17, {{.*}}
+; CHECK: store i64 17, {{.*}}
+; CHECK: call void @race_check_batch(i32 %{{[0-9]+}}, { i8*, i64, i8* }* %race.batch, i32 2)
+define void @a(i8* %obj) {
+  store i32 1, i32* getelementptr (%struct.pair, %struct.pair* @p, i32 0, i32 0)
+  store i32 2, i32* getelementptr (%struct.pair, %struct.pair* @p, i32 0, i32 1)
+  store i64 1, i64* @x
+  ret void
+}
+
+define void @b(i8* %obj) {
+  store i64 2, i64* @x
+  ret void
+}
+
+; CHECK-LABEL: define i32 @user_main(
+; CHECK: %r = add i32
+; CHECK-NEXT: {{.*}} = getelementptr
+; CHECK-NEXT: {{.*}} = getelementptr
+; CHECK-NEXT: store i8* bitcast (%struct.pair* @p to i8*)
+; CHECK-NEXT: {{.*}} = getelementptr
+; CHECK-NEXT: store i64 16, {{.*}}
+; CHECK-NEXT: {{.*}} = getelementptr
+; CHECK-NEXT: store i8* blockaddress(@user_main, %race.site{{[0-9]*}}),
+; CHECK-NEXT: call void @race_check_batch(i32 %{{[0-9]+}}, { i8*, i64, i8* }* %race.batch, i32 1)
+; CHECK-NEXT: ret i32 %r
+define i32 @user_main(i32 %argc, i8** %argv) {
+  %t1 = alloca i8*
+  %t2 = alloca i8*
+  call i32 @thrd_create(i8** %t1, void (i8*)* @a, i8* null)
+  call i32 @thrd_create(i8** %t2, void (i8*)* @b, i8* null)
+  %h1 = load i8*, i8** %t1
+  call i32 @thrd_join(i8* %h1)
+  %h2 = load i8*, i8** %t2
+  call i32 @thrd_join(i8* %h2)
+  %pa = load i32, i32* getelementptr (%struct.pair, %struct.pair* @p, i32 0, i32 0)
+  %pb = load i32, i32* getelementptr (%struct.pair, %struct.pair* @p, i32 0, i32 1)
+  %r = add i32 %pa, %pb
+  ret i32 %r
+}
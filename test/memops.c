@@ -0,0 +1,45 @@
+/**
+ * @file memops.c
+ * @brief Region-wide race checks (race_memcpy/race_memset)
+ *
+ * Thread a fills the first half of a buffer while thread b copies out of the
+ * second half, which must not be reported as a race. Thread b's copy also
+ * reads the first byte of the first half, which races with thread a's fill;
+ * the main thread moves the (now ordered) data around after joining them.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <threads.h>
+
+#include "librace.h"
+
+#define HALF 64
+
+uint8_t buf[2 * HALF] __attribute__((aligned(8)));
+uint8_t out[HALF + 1];
+
+static void a(void *obj)
+{
+	race_memset(buf, 1, HALF);
+}
+
+static void b(void *obj)
+{
+	race_memcpy(out, buf + HALF, HALF);
+	race_memcpy(out + HALF, buf, 1);
+}
+
+int user_main(int argc, char **argv)
+{
+	thrd_t t1, t2;
+
+	thrd_create(&t1, (thrd_start_t)&a, NULL);
+	thrd_create(&t2, (thrd_start_t)&b, NULL);
+
+	thrd_join(t1);
+	thrd_join(t2);
+
+	race_memmove(buf + 1, buf, 2 * HALF - 1);
+	printf("buf[%d]=%u\n", HALF, load_8(&buf[HALF]));
+	return 0;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file mixed-atomic.c
+ * @brief Mixed atomic and non-atomic accesses to the same objects
+ *
+ * The main thread's atomic_init() calls are non-atomic writes, but they are
+ * ordered before the threads' atomic accesses by thread creation. Thread a
+ * resets flag with a plain store, which races with thread b's atomic load of
+ * it.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <threads.h>
+#include <stdatomic.h>
+
+#include "librace.h"
+
+atomic_int x;
+atomic_int flag;
+
+static void a(void *obj)
+{
+	atomic_store_explicit(&x, 1, memory_order_relaxed);
+	store_32(&flag, 0);
+}
+
+static void b(void *obj)
+{
+	int r1 = atomic_load_explicit(&x, memory_order_relaxed);
+	int r2 = atomic_load_explicit(&flag, memory_order_relaxed);
+	printf("r1=%d r2=%d\n", r1, r2);
+}
+
+int user_main(int argc, char **argv)
+{
+	thrd_t t1, t2;
+
+	atomic_init(&x, 0);
+	atomic_init(&flag, 1);
+
+	thrd_create(&t1, (thrd_start_t)&a, NULL);
+	thrd_create(&t2, (thrd_start_t)&b, NULL);
+
+	thrd_join(t1);
+	thrd_join(t2);
+
+	return 0;
+}
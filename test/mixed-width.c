@@ -0,0 +1,44 @@
+/**
+ * @file mixed-width.c
+ * @brief Mixed-width non-atomic accesses
+ *
+ * Threads a and b write disjoint halves of the same 8-byte word, which must
+ * not be reported as a race; the main thread reads the whole word after
+ * joining them. Thread b also does an unaligned 16-bit store straddling two
+ * words, which races with thread a's read of the byte just past the first
+ * word boundary.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <threads.h>
+
+#include "librace.h"
+
+uint64_t word;
+uint8_t straddle[16] __attribute__((aligned(8)));
+
+static void a(void *obj)
+{
+	store_32(&word, 1);
+	printf("straddle[8]=%u\n", load_8(&straddle[8]));
+}
+
+static void b(void *obj)
+{
+	store_32((char *)&word + 4, 2);
+	store_16(&straddle[7], 0x0303);
+}
+
+int user_main(int argc, char **argv)
+{
+	thrd_t t1, t2;
+
+	thrd_create(&t1, (thrd_start_t)&a, NULL);
+	thrd_create(&t2, (thrd_start_t)&b, NULL);
+
+	thrd_join(t1);
+	thrd_join(t2);
+
+	printf("word=%llx\n", (unsigned long long)load_64(&word));
+	return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * Message passing through a busy-wait loop: the consumers spin on a flag
+ * until the producer publishes its data. The loops must be bounded with -b
+ * or -m; with --spinblock, a spinning consumer also blocks until the flag is
+ * written, so fewer interleavings of its iterations are explored.
+ */
+
+#include <stdio.h>
+#include <threads.h>
+#include <stdatomic.h>
+
+#include "librace.h"
+#include "model-assert.h"
+
+atomic_int flag;
+atomic_int ready;
+int data;
+
+static void producer(void *obj)
+{
+	store_32(&data, 42);
+	atomic_store_explicit(&flag, 1, memory_order_release);
+}
+
+static void consumer(void *obj)
+{
+	while (!atomic_load_explicit(&flag, memory_order_acquire))
+		;
+	MODEL_ASSERT(load_32(&data) == 42);
+	atomic_fetch_add_explicit(&ready, 1, memory_order_relaxed);
+}
+
+int user_main(int argc, char **argv)
+{
+	thrd_t t1, t2, t3;
+
+	atomic_init(&flag, 0);
+	atomic_init(&ready, 0);
+
+	thrd_create(&t1, (thrd_start_t)&consumer, NULL);
+	thrd_create(&t2, (thrd_start_t)&consumer, NULL);
+	thrd_create(&t3, (thrd_start_t)&producer, NULL);
+
+	thrd_join(t1);
+	thrd_join(t2);
+	thrd_join(t3);
+
+	MODEL_ASSERT(atomic_load_explicit(&ready, memory_order_relaxed) == 2);
+	printf("Main thread is finished\n");
+
+	return 0;
+}
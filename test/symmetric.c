@@ -0,0 +1,41 @@
+/*
+ * Identical workers, created with thrd_create_symmetric(). With -X, the
+ * executions that only differ by which worker did what are explored once.
+ */
+
+#include <stdio.h>
+#include <threads.h>
+#include <stdatomic.h>
+
+#include "model-assert.h"
+
+#define NUM_WORKERS 3
+
+atomic_int x;
+atomic_int done;
+
+static void worker(void *obj)
+{
+	int r = atomic_load_explicit(&x, memory_order_acquire);
+	atomic_store_explicit(&x, r + 1, memory_order_release);
+	atomic_fetch_add_explicit(&done, 1, memory_order_release);
+}
+
+int user_main(int argc, char **argv)
+{
+	thrd_t workers[NUM_WORKERS];
+	int i;
+
+	atomic_init(&x, 0);
+	atomic_init(&done, 0);
+
+	for (i = 0; i < NUM_WORKERS; i++)
+		thrd_create_symmetric(&workers[i], (thrd_start_t)&worker, NULL);
+	for (i = 0; i < NUM_WORKERS; i++)
+		thrd_join(workers[i]);
+
+	MODEL_ASSERT(atomic_load_explicit(&done, memory_order_relaxed) == NUM_WORKERS);
+	printf("x = %d\n", atomic_load_explicit(&x, memory_order_relaxed));
+
+	return 0;
+}
@@ -16,6 +16,8 @@
 struct thread_params {
 	thrd_start_t func;
 	void *arg;
+	/** @brief Created with thrd_create_symmetric() */
+	bool symmetric;
 };
 
 /** @brief Represents the state of a user Thread */
@@ -45,8 +47,9 @@ public:
 	~Thread();
 	void complete();
 
-	static int swap(ucontext_t *ctxt, Thread *t);
-	static int swap(Thread *t, ucontext_t *ctxt);
+	static int swap(model_context_t *ctxt, Thread *t);
+	static int swap(Thread *t, model_context_t *ctxt);
+	static int swap(Thread *from, Thread *to);
 
 	thread_state get_state() const { return state; }
 	void set_state(thread_state s);
@@ -57,6 +60,13 @@ public:
 	void set_creation(ModelAction *act) { creation = act; }
 	ModelAction * get_creation() const { return creation; }
 
+	thrd_start_t get_start_routine() const { return start_routine; }
+
+	/** @return The first thread this one is interchangeable with, or
+	 *  THREAD_ID_T_NONE; see Thread::symmetry_class */
+	thread_id_t get_symmetry_class() const { return symmetry_class; }
+	void set_symmetry_class(thread_id_t tid) { symmetry_class = tid; }
+
 	/**
 	 * Set a return value for the last action in this thread (e.g., for an
 	 * atomic read).
@@ -132,7 +142,18 @@ private:
 
 	void (*start_routine)(void *);
 	void *arg;
-	ucontext_t context;
+
+	/**
+	 * @brief The first of the threads this one is interchangeable with
+	 *
+	 * Threads created with thrd_create_symmetric(), with the same start
+	 * routine, one after the other by the same parent, share a symmetry
+	 * class (when symmetry reduction is enabled). Otherwise
+	 * THREAD_ID_T_NONE.
+	 */
+	thread_id_t symmetry_class;
+
+	model_context_t context;
 	void *stack;
 	thrd_t *user_thread;
 	thread_id_t id;
@@ -150,6 +171,7 @@ private:
 };
 
 Thread * thread_current();
+void stack_pool_init();
 
 static inline thread_id_t thrd_to_id(thrd_t t)
 {
@@ -3,6 +3,7 @@
  */
 
 #include <string.h>
+#include <sys/mman.h>
 
 #include <threads.h>
 #include <mutex>
@@ -13,16 +14,55 @@
 /* global "model" object */
 #include "model.h"
 
-/** Allocate a stack for a new thread. */
-static void * stack_allocate(size_t size)
+/**
+ * @brief The pooled stack of each thread id, or NULL if not yet mapped
+ *
+ * Every execution is rolled back to before any user thread was created, so a
+ * stack's contents never need to be saved or restored; the stacks live
+ * outside of the snapshotted heap and are simply reused.
+ */
+static void *stack_pool[STACK_POOL_SLOTS];
+
+/** @brief The address space reserved for the pooled stacks */
+static char *stack_region;
+
+/**
+ * @brief Reserve the address space of the pooled stacks
+ *
+ * This is done once, before the model checker maps anything else, so that
+ * the stacks (and the user program's objects on them) are at the same
+ * addresses in every run of the same program. Checkpoints rely on this; see
+ * ModelChecker::restore_checkpoint().
+ */
+void stack_pool_init()
 {
-	return snapshot_malloc(size);
+	void *mem = mmap(NULL, STACK_POOL_SLOTS * (PAGESIZE + STACK_SIZE), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (mem == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+	stack_region = (char *)mem;
 }
 
-/** Free a stack for a terminated thread. */
-static void stack_free(void *stack)
+/**
+ * Allocate a stack for a new thread. Pooled stacks are made accessible on
+ * first use, leaving a guard page below them, and their pages are only
+ * committed when touched.
+ */
+static void * stack_allocate(thread_id_t tid, size_t size)
 {
-	snapshot_free(stack);
+	unsigned int slot = id_to_int(tid);
+	if (slot >= STACK_POOL_SLOTS || size != STACK_SIZE)
+		return snapshot_malloc(size);
+	if (!stack_pool[slot]) {
+		char *stack = stack_region + slot * (PAGESIZE + STACK_SIZE) + PAGESIZE;
+		if (mprotect(stack, STACK_SIZE, PROT_READ | PROT_WRITE)) {
+			perror("mprotect");
+			exit(EXIT_FAILURE);
+		}
+		stack_pool[slot] = stack;
+	}
+	return stack_pool[slot];
 }
 
 /**
@@ -59,40 +99,28 @@ void thread_startup()
 
 /**
  * Create a thread context for a new thread so we can use
- * setcontext/getcontext/swapcontext to swap it out.
+ * model_swapcontext to swap it out.
  * @return 0 on success; otherwise, non-zero error condition
  */
 int Thread::create_context()
 {
-	int ret;
-
-	ret = getcontext(&context);
-	if (ret)
-		return ret;
-
 	/* Initialize new managed context */
-	stack = stack_allocate(STACK_SIZE);
-	context.uc_stack.ss_sp = stack;
-	context.uc_stack.ss_size = STACK_SIZE;
-	context.uc_stack.ss_flags = 0;
-	context.uc_link = model->get_system_context();
-	makecontext(&context, thread_startup, 0);
-
-	return 0;
+	stack = stack_allocate(id, STACK_SIZE);
+	return model_makecontext(&context, stack, STACK_SIZE, thread_startup, model->get_system_context());
 }
 
 /**
  * Swaps the current context to another thread of execution. This form switches
  * from a user Thread to a system context.
  * @param t Thread representing the currently-running thread. The current
- * context is saved here.
+ * context is saved here. It must already have left THREAD_RUNNING (it may
+ * have completed in the meantime).
  * @param ctxt Context to which we will swap. Must hold a valid system context.
  * @return Does not return, unless we return to Thread t's context. See
  * swapcontext(3) (returns 0 for success, -1 for failure).
  */
-int Thread::swap(Thread *t, ucontext_t *ctxt)
+int Thread::swap(Thread *t, model_context_t *ctxt)
 {
-	t->set_state(THREAD_READY);
 	return model_swapcontext(&t->context, ctxt);
 }
 
@@ -104,21 +132,39 @@ int Thread::swap(Thread *t, ucontext_t *ctxt)
  * @return Does not return, unless we return to the system context (ctxt). See
  * swapcontext(3) (returns 0 for success, -1 for failure).
  */
-int Thread::swap(ucontext_t *ctxt, Thread *t)
+int Thread::swap(model_context_t *ctxt, Thread *t)
 {
 	t->set_state(THREAD_RUNNING);
 	return model_swapcontext(ctxt, &t->context);
 }
 
 
-/** Terminate a thread and free its stack. */
+/**
+ * Swaps the current context directly from one user Thread to another.
+ * @param from Thread representing the currently-running thread. The current
+ * context is saved here. It must already have left THREAD_RUNNING (it may
+ * have completed in the meantime).
+ * @param to Thread to which we will swap. Must hold a valid user context.
+ * @return Does not return, unless we return to Thread from's context. See
+ * swapcontext(3) (returns 0 for success, -1 for failure).
+ */
+int Thread::swap(Thread *from, Thread *to)
+{
+	to->set_state(THREAD_RUNNING);
+	return model_swapcontext(&from->context, &to->context);
+}
+
+/**
+ * Terminate a thread. Its stack is not freed, as the thread may be taking
+ * its own last step on it (see ModelChecker::switch_to_master): pooled
+ * stacks are reused, and others are reclaimed by the rollback at the end of
+ * the execution.
+ */
 void Thread::complete()
 {
 	ASSERT(!is_complete());
 	DEBUG("completed thread %d\n", id_to_int(get_id()));
 	state = THREAD_COMPLETED;
-	if (stack)
-		stack_free(stack);
 }
 
 /**
@@ -135,6 +181,7 @@ Thread::Thread(thread_id_t tid) :
 	pending(NULL),
 	start_routine(NULL),
 	arg(NULL),
+	symmetry_class(THREAD_ID_T_NONE),
 	stack(NULL),
 	user_thread(NULL),
 	id(tid),
@@ -157,6 +204,7 @@ Thread::Thread(thread_id_t tid, thrd_t *t, void (*func)(void *), void *a, Thread
 	pending(NULL),
 	start_routine(func),
 	arg(a),
+	symmetry_class(THREAD_ID_T_NONE),
 	user_thread(t),
 	id(tid),
 	state(THREAD_CREATED),
@@ -0,0 +1,178 @@
+/** @file threadset.h
+ *  @brief A set of thread IDs, stored as a bitset.
+ */
+
+#ifndef __THREADSET_H__
+#define __THREADSET_H__
+
+#include <stdint.h>
+#include <string.h>
+#include "mymemory.h"
+
+/**
+ * @brief A set of thread IDs, stored as a bitset
+ *
+ * Sets of up to 64 threads live in a single inline word, so membership,
+ * updates, counting (popcount) and finding the next member (count trailing
+ * zeros) are constant-time. Larger sets spill into an array of words
+ * allocated with the given functions (by default, snapshotting).
+ *
+ * Sets are not copyable; use copy_from().
+ *
+ * @tparam _malloc Provide your own 'malloc' for the words, or default to
+ *                 snapshotting.
+ * @tparam _free   Provide your own 'free' for the words, or default to
+ *                 snapshotting.
+ */
+template<void * (* _malloc)(size_t) = snapshot_malloc, void (*_free)(void *) = snapshot_free>
+class ThreadSet {
+ public:
+	ThreadSet() : numwords(1) {
+		bits.word = 0;
+	}
+
+	~ThreadSet() {
+		if (numwords > 1)
+			_free(bits.words);
+	}
+
+	/** @return The number of 64-bit words in use */
+	unsigned int get_num_words() const { return numwords; }
+
+	/** @return The word holding the members 64 * w to 64 * w + 63 */
+	uint64_t get_word(unsigned int w) const {
+		if (w >= numwords)
+			return 0;
+		return numwords == 1 ? bits.word : bits.words[w];
+	}
+
+	bool contains(unsigned int i) const {
+		return (get_word(i >> 6) >> (i & 63)) & 1;
+	}
+
+	void add(unsigned int i) {
+		grow(i);
+		*word_ptr(i >> 6) |= 1ULL << (i & 63);
+	}
+
+	void remove(unsigned int i) {
+		if ((i >> 6) < numwords)
+			*word_ptr(i >> 6) &= ~(1ULL << (i & 63));
+	}
+
+	void clear() {
+		if (numwords == 1)
+			bits.word = 0;
+		else
+			memset(bits.words, 0, numwords * sizeof(uint64_t));
+	}
+
+	bool empty() const {
+		for (unsigned int w = 0; w < numwords; w++)
+			if (get_word(w))
+				return false;
+		return true;
+	}
+
+	/** @return The number of members */
+	unsigned int count() const {
+		unsigned int n = 0;
+		for (unsigned int w = 0; w < numwords; w++)
+			n += __builtin_popcountll(get_word(w));
+		return n;
+	}
+
+	/** @return The smallest member that is at least from, or -1 if none */
+	int next(unsigned int from) const {
+		return next_excluding(from, *this, false);
+	}
+
+	/**
+	 * @return The smallest member that is at least from and (if exclude)
+	 * is not in other, or -1 if none
+	 */
+	template<typename _Set>
+	int next_excluding(unsigned int from, const _Set &other, bool exclude = true) const {
+		for (unsigned int w = from >> 6; w < numwords; w++) {
+			uint64_t word = get_word(w);
+			if (exclude)
+				word &= ~other.get_word(w);
+			if (w == (from >> 6))
+				word &= ~0ULL << (from & 63);
+			if (word)
+				return (w << 6) + __builtin_ctzll(word);
+		}
+		return -1;
+	}
+
+	/** @return The smallest member that is at least from and is in other,
+	 * or -1 if none */
+	template<typename _Set>
+	int next_common(unsigned int from, const _Set &other) const {
+		for (unsigned int w = from >> 6; w < numwords; w++) {
+			uint64_t word = get_word(w) & other.get_word(w);
+			if (w == (from >> 6))
+				word &= ~0ULL << (from & 63);
+			if (word)
+				return (w << 6) + __builtin_ctzll(word);
+		}
+		return -1;
+	}
+
+	/** Makes this set hold the members of other that are below limit */
+	template<typename _Set>
+	void copy_from(const _Set &other, unsigned int limit) {
+		clear();
+		add_all(other, limit);
+	}
+
+	/** Adds the members of other that are below limit */
+	template<typename _Set>
+	void add_all(const _Set &other, unsigned int limit) {
+		if (limit == 0)
+			return;
+		grow(limit - 1);
+		for (unsigned int w = 0; w <= ((limit - 1) >> 6); w++) {
+			uint64_t word = other.get_word(w);
+			if (((w + 1) << 6) > limit)
+				word &= (1ULL << (limit & 63)) - 1;
+			*word_ptr(w) |= word;
+		}
+	}
+
+ private:
+	ThreadSet(const ThreadSet &);
+	ThreadSet & operator=(const ThreadSet &);
+
+	uint64_t * word_ptr(unsigned int w) {
+		return numwords == 1 ? &bits.word : &bits.words[w];
+	}
+
+	/** Makes room for member i */
+	void grow(unsigned int i) {
+		unsigned int needed = (i >> 6) + 1;
+		if (needed <= numwords)
+			return;
+		uint64_t *words = (uint64_t *)_malloc(needed * sizeof(uint64_t));
+		memset(words, 0, needed * sizeof(uint64_t));
+		for (unsigned int w = 0; w < numwords; w++)
+			words[w] = get_word(w);
+		if (numwords > 1)
+			_free(bits.words);
+		bits.words = words;
+		numwords = needed;
+	}
+
+	union {
+		/** @brief The members, when numwords == 1 */
+		uint64_t word;
+		/** @brief The members, when numwords > 1 */
+		uint64_t *words;
+	} bits;
+	unsigned int numwords;
+};
+
+/** @brief A ThreadSet in non-snapshotting memory */
+typedef ThreadSet<model_malloc, model_free> ModelThreadSet;
+
+#endif /* __THREADSET_H__ */